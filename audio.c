@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "audio.h"
+
+static void CHIP8_audio_null_set(CHIP8_audio_t *audio, uint64_t frame, bool on) {
+  CHIP8_audio_null_t *null = (CHIP8_audio_null_t *)audio;
+  (void)on; // edges alternate, the parity of the index says which way
+  if (null->failed) return;
+  if (null->count == null->capacity) {
+    const size_t capacity = null->capacity ? null->capacity * 2 : 64;
+    uint64_t *edges = realloc(null->edges, capacity * sizeof(uint64_t));
+    if (edges == NULL) {
+      // skipping just this edge would swap every later on for an off
+      null->failed = true;
+      null->failed_frame = frame;
+      return;
+    }
+    null->edges = edges;
+    null->capacity = capacity;
+  }
+  null->edges[null->count++] = frame;
+}
+
+void CHIP8_audio_null_init(CHIP8_audio_null_t *null) {
+  null->audio.on = false;
+  null->audio.set = CHIP8_audio_null_set;
+  null->edges = NULL;
+  null->count = 0;
+  null->capacity = 0;
+  null->failed = false;
+  null->failed_frame = 0;
+}
+
+void CHIP8_audio_null_free(CHIP8_audio_null_t *null) {
+  free(null->edges);
+  null->edges = NULL;
+  null->count = null->capacity = 0;
+}
+
+// One line per beep with the frames it started and stopped on, then the totals.
+// A log that ran out of memory only covers the frames before its last edge.
+void CHIP8_audio_null_dump(const CHIP8_audio_null_t *null, uint64_t frames, FILE *out) {
+  uint64_t on_frames = 0;
+  if (null->failed) frames = null->failed_frame;
+  fprintf(out, "sound:\n");
+  for (size_t i = 0; i < null->count; i += 2) {
+    const uint64_t end = i + 1 < null->count ? null->edges[i + 1] : frames;
+    fprintf(out, "\tframes %llu-%llu (%llu)%s\n",
+      (unsigned long long)null->edges[i],
+      (unsigned long long)end,
+      (unsigned long long)(end - null->edges[i]),
+      i + 1 < null->count ? "" : null->failed ? " then not recorded" : " still on");
+    on_frames += end - null->edges[i];
+  }
+  fprintf(out, "\t%zu beeps, %llu of %llu frames on\n", (null->count + 1) / 2, (unsigned long long)on_frames, (unsigned long long)frames);
+  if (null->failed) {
+    fprintf(out, "\tout of memory at frame %llu, nothing after it was recorded\n", (unsigned long long)null->failed_frame);
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Where the beeper goes. The core reports the tone state (S > 0) after every 60 Hz timer tick
+// and the sink is only called when it changes, so sinks see the exact timer timeline.
+typedef struct CHIP8_audio_s CHIP8_audio_t;
+struct CHIP8_audio_s {
+  bool on;
+  void (*set)(CHIP8_audio_t *audio, uint64_t frame, bool on);
+};
+
+static inline void CHIP8_audio_update(CHIP8_audio_t *audio, uint64_t frame, bool on) {
+  if (on != audio->on) {
+    audio->on = on;
+    audio->set(audio, frame, on);
+  }
+}
+
+// Null sink, makes no sound and keeps the frame of every on/off edge for headless checks
+typedef struct {
+  CHIP8_audio_t audio;
+  uint64_t *edges; // frame numbers, even entries turn the tone on and odd ones off
+  size_t count;
+  size_t capacity;
+  bool failed;          // an edge couldn't be stored, recording stopped there so the parity stays right
+  uint64_t failed_frame; // frame of that edge
+} CHIP8_audio_null_t;
+
+void CHIP8_audio_null_init(CHIP8_audio_null_t *null);
+void CHIP8_audio_null_free(CHIP8_audio_null_t *null);
+void CHIP8_audio_null_dump(const CHIP8_audio_null_t *null, uint64_t frames, FILE *out);
+
+#endif
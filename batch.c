@@ -0,0 +1,333 @@
+#define _POSIX_C_SOURCE 200809L // sysconf, clock_gettime, strdup
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "chip8.h"
+#include "batch.h"
+#include "rom.h"
+
+// One headless run, filled in by whichever worker ends up executing it
+typedef struct {
+  char *rom;
+  uint64_t cycles;
+  uint32_t clock_rate;
+  uint64_t seed;
+  CHIP8_engine_t engine;
+  CHIP8_quirks_t quirks;
+  bool quirks_set;
+  bool idle_skip;
+  // results
+  int status;         // 0 ran to its cycle count, -1 ROM failed to load, 1 quit early, by 00FD or a fault
+  CHIP8_fault_t fault; // why it quit, if it halted itself
+  uint64_t executed;
+  uint64_t hash;
+} CHIP8_job_t;
+
+// Each worker owns a contiguous range of job indices [head, tail). The owner takes from the tail,
+// idle workers steal from the head of someone else's range, so short and long ROMs even out
+typedef struct {
+  pthread_mutex_t lock;
+  size_t head;
+  size_t tail;
+} CHIP8_deque_t;
+
+typedef struct {
+  CHIP8_job_t *jobs;
+  CHIP8_deque_t *deques;
+  int workers;
+  CHIP8_rom_cache_t *roms; // every ROM is mapped and hashed once however many jobs run it
+  const CHIP8_romdb_t *db;
+} CHIP8_pool_t;
+
+typedef struct {
+  CHIP8_pool_t *pool;
+  int id;
+} CHIP8_worker_t;
+
+static bool CHIP8_deque_pop(CHIP8_deque_t *deque, size_t *job) {
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->head < deque->tail) {
+    *job = --deque->tail;
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+static bool CHIP8_deque_steal(CHIP8_deque_t *deque, size_t *job) {
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->head < deque->tail) {
+    *job = deque->head++;
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+static void CHIP8_job_execute(CHIP8_pool_t *pool, CHIP8_job_t *job) {
+  const CHIP8_rom_t *rom = CHIP8_rom_cache_get(pool->roms, job->rom);
+  if (rom == NULL) {
+    job->status = -1;
+    return;
+  }
+  // the database fills in whatever the options and manifest left open
+  const CHIP8_romdb_entry_t *entry = pool->db ? CHIP8_romdb_find(pool->db, rom->sha1) : NULL;
+  if (entry) {
+    if (!job->clock_rate) job->clock_rate = entry->clock_rate;
+    if (!job->quirks_set && entry->has_quirks) job->quirks = entry->quirks;
+  }
+  CHIP8_t *chip8_i = CHIP8_create(job->clock_rate);
+  if (chip8_i == NULL) {
+    job->status = -1;
+    return;
+  }
+  chip8_i->engine = job->engine;
+  chip8_i->idle_skip = job->idle_skip;
+  CHIP8_set_quirks(chip8_i, job->quirks);
+  CHIP8_seed(chip8_i, job->seed);
+  if (CHIP8_load(chip8_i, job->rom, rom->data, rom->size)) {
+    job->status = -1;
+    CHIP8_destroy(chip8_i);
+    return;
+  }
+  CHIP8_run_headless(chip8_i, job->cycles);
+  job->status = chip8_i->run_state == QUIT ? 1 : 0;
+  job->fault = chip8_i->fault;
+  job->executed = chip8_i->cycles;
+  job->hash = CHIP8_state_hash(chip8_i);
+  CHIP8_destroy(chip8_i);
+}
+
+static void *CHIP8_worker_main(void *arg) {
+  CHIP8_worker_t *worker = arg;
+  CHIP8_pool_t *pool = worker->pool;
+  size_t job;
+  for (;;) {
+    if (CHIP8_deque_pop(&pool->deques[worker->id], &job)) {
+      CHIP8_job_execute(pool, &pool->jobs[job]);
+      continue;
+    }
+    // own range is empty, look for work starting at the next worker so thieves spread out
+    bool stolen = false;
+    for (int i = 1; i < pool->workers && !stolen; i++) {
+      stolen = CHIP8_deque_steal(&pool->deques[(worker->id + i) % pool->workers], &job);
+    }
+    if (!stolen) break; // jobs never create jobs, so nothing left anywhere means we're done
+    CHIP8_job_execute(pool, &pool->jobs[job]);
+  }
+  return NULL;
+}
+
+static bool CHIP8_is_rom_name(const char *name) {
+  const size_t len = strlen(name);
+  return len > 4 && !strcmp(name + len - 4, ".ch8");
+}
+
+static int CHIP8_job_push(CHIP8_job_t **jobs, size_t *count, size_t *capacity, const CHIP8_job_t *job) {
+  if (*count == *capacity) {
+    size_t grown = *capacity ? *capacity * 2 : 64;
+    CHIP8_job_t *resized = realloc(*jobs, grown * sizeof(CHIP8_job_t));
+    if (resized == NULL) return -1;
+    *jobs = resized;
+    *capacity = grown;
+  }
+  (*jobs)[(*count)++] = *job;
+  return 0;
+}
+
+static void CHIP8_jobs_free(CHIP8_job_t *jobs, size_t count) {
+  for (size_t i = 0; i < count; i++) free(jobs[i].rom);
+  free(jobs);
+}
+
+static int CHIP8_rom_name_cmp(const void *a, const void *b) {
+  return strcmp(((const CHIP8_job_t *)a)->rom, ((const CHIP8_job_t *)b)->rom);
+}
+
+// A directory runs every *.ch8 in it with the default options, anything else is read as a manifest:
+// one run per line, "rom [cycles [clock-rate [seed [engine [quirks]]]]]", blank lines and # comments ignored
+static int CHIP8_batch_load(const char *source, const CHIP8_batch_options_t *options, CHIP8_job_t **jobs, size_t *count) {
+  size_t capacity = 0;
+  const CHIP8_job_t defaults = {
+    .cycles = options->cycles,
+    .clock_rate = options->clock_rate,
+    .seed = options->seed,
+    .engine = options->engine,
+    .quirks = options->quirks,
+    .quirks_set = options->quirks_set,
+    .idle_skip = options->idle_skip
+  };
+
+  DIR *dir = opendir(source);
+  if (dir) {
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+      if (!CHIP8_is_rom_name(entry->d_name)) continue;
+      CHIP8_job_t job = defaults;
+      job.rom = malloc(strlen(source) + strlen(entry->d_name) + 2);
+      if (job.rom) sprintf(job.rom, "%s/%s", source, entry->d_name);
+      if (job.rom == NULL || CHIP8_job_push(jobs, count, &capacity, &job)) {
+        // a batch missing some of the directory would look like a complete one
+        fprintf(stderr, "Could not allocate batch job for %s/%s\n", source, entry->d_name);
+        free(job.rom);
+        closedir(dir);
+        CHIP8_jobs_free(*jobs, *count);
+        *jobs = NULL;
+        *count = 0;
+        return -1;
+      }
+    }
+    closedir(dir);
+    // readdir order is arbitrary, sort so reports are stable
+    qsort(*jobs, *count, sizeof(CHIP8_job_t), CHIP8_rom_name_cmp);
+    return 0;
+  }
+
+  FILE *manifest = fopen(source, "r");
+  if (!manifest) {
+    fprintf(stderr, "Could not open batch source %s\n", source);
+    return -1;
+  }
+  char line[1024];
+  int lineno = 0;
+  while (fgets(line, sizeof(line), manifest)) {
+    lineno++;
+    char *fields[6] = { NULL };
+    int nfields = 0;
+    for (char *tok = strtok(line, " \t\r\n"); tok && nfields < 6; tok = strtok(NULL, " \t\r\n")) {
+      if (tok[0] == '#') break;
+      fields[nfields++] = tok;
+    }
+    if (!nfields) continue;
+    CHIP8_job_t job = defaults;
+    if (nfields > 1) job.cycles = strtoull(fields[1], NULL, 0);
+    if (nfields > 2) job.clock_rate = (uint32_t)strtoul(fields[2], NULL, 0);
+    if (nfields > 3) job.seed = strtoull(fields[3], NULL, 0);
+    if (nfields > 4 && CHIP8_engine_from_name(fields[4], &job.engine)) {
+      fprintf(stderr, "%s:%d: unknown engine %s\n", source, lineno, fields[4]);
+      continue;
+    }
+    if (nfields > 5 && CHIP8_quirks_from_name(fields[5], &job.quirks)) {
+      fprintf(stderr, "%s:%d: unknown quirk profile %s\n", source, lineno, fields[5]);
+      continue;
+    }
+    if (nfields > 5) job.quirks_set = true;
+    job.rom = strdup(fields[0]);
+    if (job.rom == NULL || CHIP8_job_push(jobs, count, &capacity, &job)) {
+      fprintf(stderr, "%s:%d: could not allocate batch job for %s\n", source, lineno, fields[0]);
+      free(job.rom);
+      fclose(manifest);
+      CHIP8_jobs_free(*jobs, *count);
+      *jobs = NULL;
+      *count = 0;
+      return -1;
+    }
+  }
+  fclose(manifest);
+  return 0;
+}
+
+// Run every job of the source on a pool of headless instances and print one result line per job in source order
+int CHIP8_batch_run(const char *source, const CHIP8_batch_options_t *options) {
+  CHIP8_job_t *jobs = NULL;
+  size_t count = 0;
+  if (CHIP8_batch_load(source, options, &jobs, &count)) {
+    return -1;
+  }
+  if (!count) {
+    fprintf(stderr, "No ROMs found in %s\n", source);
+    free(jobs);
+    return -1;
+  }
+
+  int workers = options->workers;
+  if (workers <= 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cores > 0 ? (int)cores : 1;
+  }
+  if ((size_t)workers > count) workers = (int)count;
+
+  // shared tables must exist before any thread creates an instance
+  CHIP8_build_dispatch();
+
+  CHIP8_romdb_t db = { NULL, 0 };
+  if (options->rom_db && CHIP8_romdb_load(&db, options->rom_db)) {
+    CHIP8_jobs_free(jobs, count);
+    return -1;
+  }
+
+  CHIP8_pool_t pool = { jobs, calloc(workers, sizeof(CHIP8_deque_t)), workers, CHIP8_rom_cache_create(), options->rom_db ? &db : NULL };
+  CHIP8_worker_t *worker_args = calloc(workers, sizeof(CHIP8_worker_t));
+  pthread_t *threads = calloc(workers, sizeof(pthread_t));
+  if (pool.deques == NULL || pool.roms == NULL || worker_args == NULL || threads == NULL) {
+    fprintf(stderr, "Could not allocate worker pool\n");
+    CHIP8_rom_cache_destroy(pool.roms);
+    CHIP8_romdb_free(&db);
+    free(pool.deques);
+    free(worker_args);
+    free(threads);
+    CHIP8_jobs_free(jobs, count);
+    return -1;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_init(&pool.deques[i].lock, NULL);
+    pool.deques[i].head = count * i / workers;
+    pool.deques[i].tail = count * (i + 1) / workers;
+  }
+  int started = 0;
+  for (int i = 0; i < workers; i++) {
+    worker_args[i].pool = &pool;
+    worker_args[i].id = i;
+    if (pthread_create(&threads[started], NULL, CHIP8_worker_main, &worker_args[i])) {
+      // the running workers will steal this worker's share
+      fprintf(stderr, "Could not start worker %d\n", i);
+      continue;
+    }
+    started++;
+  }
+  if (!started) {
+    // no threads at all, this thread steals everything itself
+    CHIP8_worker_main(&worker_args[0]);
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  int failed = 0;
+  uint64_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    const CHIP8_job_t *job = &jobs[i];
+    const char *status = job->status == 0 ? "ok" : job->status < 0 ? "load-error" : job->fault ? CHIP8_fault_names[job->fault] : "quit";
+    printf("0x%016llX %12llu %-10s %s\n", (unsigned long long)job->hash, (unsigned long long)job->executed, status, job->rom);
+    total += job->executed;
+    // a program that exits with 00FD finished cleanly, only faults and load errors fail the batch
+    if (job->status < 0 || job->fault) failed++;
+  }
+  const double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%zu runs, %d failed, %d workers, %.3f s, %.2f M instr/s total\n", count, failed, workers, secs, secs > 0 ? total / secs / 1e6 : 0.0);
+
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_destroy(&pool.deques[i].lock);
+  }
+  CHIP8_jobs_free(jobs, count);
+  CHIP8_rom_cache_destroy(pool.roms);
+  CHIP8_romdb_free(&db);
+  free(pool.deques);
+  free(worker_args);
+  free(threads);
+  return failed ? 1 : 0;
+}
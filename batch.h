@@ -0,0 +1,24 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+// Defaults for every run, a manifest line can override them
+typedef struct {
+  uint64_t cycles;
+  uint32_t clock_rate;
+  uint64_t seed;
+  CHIP8_engine_t engine;
+  CHIP8_quirks_t quirks;
+  bool quirks_set;    // quirks was given explicitly, so the ROM database doesn't override it
+  bool idle_skip;     // fast-forward idle loops, see CHIP8_t
+  const char *rom_db; // optional ROM database for clock rates and quirks, NULL for none
+  int workers;        // 0 = one per online core
+} CHIP8_batch_options_t;
+
+int CHIP8_batch_run(const char *source, const CHIP8_batch_options_t *options);
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include <SDL.h>
+
+#include "audio.h"
+#include "beeper.h"
+
+#define CHIP8_BEEPER_VOLUME 6000
+#define CHIP8_BEEPER_RAMP 8 // table entries spent on each edge of the square, softens the click
+
+static void CHIP8_beeper_set(CHIP8_audio_t *audio, uint64_t frame, bool on) {
+  (void)frame;
+  atomic_store_explicit(&((CHIP8_beeper_t *)audio)->on, on, memory_order_relaxed);
+}
+
+// Audio thread, fills one buffer of samples
+static void CHIP8_beeper_callback(void *data, Uint8 *stream, int len) {
+  CHIP8_beeper_t *beeper = data;
+  int16_t *out = (int16_t *)(void *)stream;
+  const int count = len / (int)sizeof(int16_t);
+  if (!atomic_load_explicit(&beeper->on, memory_order_relaxed)) {
+    memset(stream, 0, len);
+    beeper->phase = 0; // every beep starts at the same point of the wave
+    return;
+  }
+  for (int i = 0; i < count; i++) {
+    out[i] = beeper->table[beeper->phase >> 24];
+    beeper->phase += beeper->step;
+  }
+}
+
+// samples is the device buffer size, smaller means lower latency and more callbacks
+CHIP8_beeper_t* CHIP8_beeper_create(uint16_t samples) {
+  CHIP8_beeper_t *beeper = malloc(sizeof(CHIP8_beeper_t));
+  if (beeper == NULL) {
+    SDL_Log("Could not allocate beeper\n");
+    return NULL;
+  }
+  beeper->audio.on = false;
+  beeper->audio.set = CHIP8_beeper_set;
+  atomic_init(&beeper->on, false);
+  beeper->phase = 0;
+  beeper->step = (uint32_t)(((uint64_t)CHIP8_BEEPER_TONE << 32) / CHIP8_BEEPER_RATE);
+
+  // square wave with short linear ramps at the edges
+  for (int i = 0; i < CHIP8_BEEPER_TABLE; i++) {
+    const int half = CHIP8_BEEPER_TABLE / 2;
+    const int pos = i % half;
+    int level = CHIP8_BEEPER_VOLUME;
+    if (pos < CHIP8_BEEPER_RAMP) level = CHIP8_BEEPER_VOLUME * (2*pos - CHIP8_BEEPER_RAMP + 1) / CHIP8_BEEPER_RAMP;
+    beeper->table[i] = i < half ? level : -level;
+  }
+
+  SDL_AudioSpec want, have;
+  memset(&want, 0, sizeof(want));
+  want.freq = CHIP8_BEEPER_RATE;
+  want.format = AUDIO_S16SYS;
+  want.channels = 1;
+  want.samples = samples;
+  want.callback = CHIP8_beeper_callback;
+  want.userdata = beeper;
+  beeper->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+  if (beeper->device == 0) {
+    SDL_Log("SDL could not open audio device: %s\n", SDL_GetError());
+    free(beeper);
+    return NULL;
+  }
+  SDL_PauseAudioDevice(beeper->device, 0);
+  return beeper;
+}
+
+void CHIP8_beeper_destroy(CHIP8_beeper_t *beeper) {
+  if (beeper == NULL) return;
+  SDL_CloseAudioDevice(beeper->device);
+  free(beeper);
+}
@@ -0,0 +1,30 @@
+#ifndef BEEPER_H
+#define BEEPER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include <SDL.h>
+
+#include "audio.h"
+
+#define CHIP8_BEEPER_RATE 48000
+#define CHIP8_BEEPER_TONE 440
+#define CHIP8_BEEPER_TABLE 256 // one period of the tone, indexed by the top 8 bits of the phase
+
+// SDL audio sink, the callback plays the wavetable while on is set and silence otherwise.
+// The emulation thread only flips on, the audio thread never allocates or locks.
+typedef struct {
+  CHIP8_audio_t audio; // first so the core's sink pointer is the beeper
+  SDL_AudioDeviceID device;
+  _Atomic bool on;
+  uint32_t phase;      // audio thread only
+  uint32_t step;       // phase increment per sample for CHIP8_BEEPER_TONE
+  int16_t table[CHIP8_BEEPER_TABLE];
+} CHIP8_beeper_t;
+
+CHIP8_beeper_t* CHIP8_beeper_create(uint16_t samples);
+void CHIP8_beeper_destroy(CHIP8_beeper_t *beeper);
+
+#endif
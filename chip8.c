@@ -0,0 +1,1558 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "audio.h"
+#include "stats.h"
+#include "trace.h"
+#include "rom.h"
+
+const uint8_t font[] = {
+  0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+  0x20, 0x60, 0x20, 0x20, 0x70, // 1
+  0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+  0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+  0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+  0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+  0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+  0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+  0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+  0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+  0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+  0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+  0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+  0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+  0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+  0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+// SUPER-CHIP 8x10 digits for FX30, with the XO-CHIP A-F, loaded at CHIP8_BIG_FONT
+const uint8_t big_font[] = {
+  0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+  0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+  0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+  0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+  0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+  0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+  0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+  0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+  0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+  0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+  0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+// Threaded engine: straight line runs of instructions ending at a jump, call, return or skip are translated
+// once into an array of (label, operands) and executed with computed goto
+#define CHIP8_BLOCK_MAX_LEN 32     // instructions per block, also bounds the invalidation scan
+#define CHIP8_BLOCK_POOL_SIZE 8192 // translated ops shared by all blocks, the cache is flushed when full
+
+typedef struct {
+  const void *label;               // handler label inside CHIP8_run_threaded
+  CHIP8_instruction_t instruction;
+  uint8_t op;                      // CHIP8_op_t, for ops that go through the handler table
+} CHIP8_top_t;
+
+typedef struct {
+  uint32_t tag;   // (generation << 16) | start PC, 0 when empty
+  uint16_t len;   // number of instructions, the op after the last one is the block end marker
+  uint16_t first; // index of the first op in the pool
+} CHIP8_block_t;
+
+struct CHIP8_blocks_s {
+  uint16_t gen;
+  uint16_t top; // next free op in the pool
+  CHIP8_block_t map[0x1000]; // keyed by the low 12 bits of the start PC, the tag holds all of it
+  CHIP8_top_t pool[CHIP8_BLOCK_POOL_SIZE];
+};
+
+static const CHIP8_handler_t CHIP8_handlers_modern[CHIP8_OP_COUNT];
+
+const CHIP8_t CHIP8_default = { .clock_rate = 700, .run_state = STOPPED, .engine = CHIP8_ENGINE_CACHED, .quirks = CHIP8_QUIRKS_MODERN, .handlers = CHIP8_handlers_modern, .mem_mask = 0xFFF, .planes = 0x1, .rom = "", .idle_skip = true };
+
+CHIP8_t* CHIP8_create(uint32_t clock_rate) {
+  // need to copy default so we don't mutate the default structure instance
+  CHIP8_t *chip8_i = malloc(sizeof(CHIP8_t));
+  if (chip8_i == NULL) {
+    fprintf(stderr, "Could not allocate CHIP8 instance\n");
+    return NULL;
+  }
+  memcpy(chip8_i, &CHIP8_default, sizeof(CHIP8_t));
+  if (clock_rate) chip8_i->clock_rate = clock_rate;
+  #ifdef CHIP8_STATS
+    chip8_i->stats = calloc(1, sizeof(CHIP8_stats_t));
+    if (chip8_i->stats == NULL) {
+      fprintf(stderr, "Could not allocate CHIP8 stats\n");
+      free(chip8_i);
+      return NULL;
+    }
+  #endif
+  CHIP8_seed(chip8_i, 0);
+  CHIP8_build_dispatch();
+  return chip8_i;
+}
+
+// an attached tracer belongs to the instance and is flushed and closed with it
+void CHIP8_destroy(CHIP8_t *chip8_i) {
+  CHIP8_trace_close(chip8_i->trace);
+  #ifdef CHIP8_STATS
+    free(chip8_i->stats);
+  #endif
+  free(chip8_i->blocks);
+  free(chip8_i);
+}
+
+// Copy a ROM image into a fresh address space and reset the CPU, the quirk profile has to be set
+// first since it decides how much memory there is. ROMs that don't fit are rejected.
+int CHIP8_load(CHIP8_t *chip8_i, char *rom_name, const uint8_t *rom, size_t size) {
+  const size_t memory = (size_t)chip8_i->mem_mask + 1;
+  if (size > memory - 0x200) {
+    fprintf(stderr, "ROM %s is %zu bytes, at most %zu fit in memory\n", rom_name, size, memory - 0x200);
+    return -1;
+  }
+  memcpy(chip8_i->MM, font, sizeof(font)); // must be in first 512 bytes https://tobiasvl.github.io/blog/write-a-chip-8-emulator/
+  memcpy(&chip8_i->MM[CHIP8_BIG_FONT], big_font, sizeof(big_font));
+  memcpy(&chip8_i->MM[0x200], rom, size);
+  memset(&chip8_i->MM[0x200 + size], 0, memory - 0x200 - size); // what the profile can reach, the state hash covers that
+  chip8_i->rom = rom_name;
+
+  #ifdef DEBUGROM
+    printf("Initializing CHIP8 instance..\n");
+    printf("Loaded ROM:\n" );
+    for (int i = 0; i < 0x400; i++) {
+      printf("\t0x%04X : 0x%02X\n", i, chip8_i->MM[i]);
+    }
+  #endif
+
+  chip8_i->PC = 0x200;
+  chip8_i->SP = 0;
+  chip8_i->fault = CHIP8_FAULT_NONE;
+  chip8_i->cycles = 0;
+  chip8_i->skipped = 0;
+  chip8_i->frames = 0;
+  chip8_i->cycle_frac = 0;
+  CHIP8_mark_dirty(chip8_i);
+  CHIP8_flush_caches(chip8_i);
+  chip8_i->run_state = STOPPED;
+  return 0;
+}
+
+int CHIP8_init(CHIP8_t *chip8_i, char *rom_name) {
+  CHIP8_rom_t *rom = CHIP8_rom_open(rom_name);
+  if (rom == NULL) {
+    return -1;
+  }
+  const int ret = CHIP8_load(chip8_i, rom_name, rom->data, rom->size);
+  CHIP8_rom_close(rom);
+  return ret;
+}
+
+// Seed the per instance RNG used by CXNN, the same seed always gives the same run
+void CHIP8_seed(CHIP8_t *chip8_i, uint64_t seed) {
+  chip8_i->seed = seed;
+  // splitmix64 so that small or zero seeds still give a well mixed, non zero xorshift state
+  uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z ^= z >> 31;
+  chip8_i->rng = z ? z : 1;
+}
+
+int CHIP8_stop(CHIP8_t *chip8_i) {
+  chip8_i->run_state = STOPPED;
+  return 0;
+}
+
+const char *const CHIP8_fault_names[CHIP8_FAULT_COUNT] = {
+  [CHIP8_FAULT_NONE] = "none",
+  [CHIP8_FAULT_STACK_OVERFLOW] = "stack-overflow",
+  [CHIP8_FAULT_STACK_UNDERFLOW] = "stack-underflow",
+  [CHIP8_FAULT_PC_RANGE] = "pc-range",
+  [CHIP8_FAULT_INVALID_OPCODE] = "invalid-opcode"
+};
+
+// Halt on something the program can't continue from, PC is left on the instruction at pc. Only reached
+// from checks that already branched, kept out of line so the handlers stay small.
+__attribute__((cold, noinline))
+static void CHIP8_fault(CHIP8_t *chip8_i, CHIP8_fault_t fault, uint16_t pc) {
+  chip8_i->PC = pc;
+  chip8_i->fault = fault;
+  chip8_i->fault_pc = pc;
+  chip8_i->run_state = QUIT;
+}
+
+// The instruction just executed finished one pass of a loop `period` instructions long that leaves the machine
+// exactly as it found it until the next timer tick or keypad change, and neither happens inside CHIP8_run.
+// Running the rest of the batch's whole passes would change nothing but cycles, so they are taken out of the
+// budget unexecuted. Traced runs execute everything so the trace has every instruction.
+static void CHIP8_idle(CHIP8_t *chip8_i, uint64_t period) {
+  if (!chip8_i->idle_skip || chip8_i->trace) return;
+  const uint64_t skip = chip8_i->budget / period * period;
+  chip8_i->budget -= skip;
+  chip8_i->skipped += skip;
+}
+
+// LD Vx, DT at pc followed by SE Vx, 0 and a jump back to pc, the usual wait for the delay timer to run out
+static bool CHIP8_delay_wait(const CHIP8_t *chip8_i, uint16_t pc) {
+  const uint16_t m = chip8_i->mem_mask;
+  const uint8_t x = chip8_i->MM[pc & m] & 0xF;
+  return pc <= 0xFFF
+    && chip8_i->MM[pc & m] == (0xF0 | x) && chip8_i->MM[(pc + 1) & m] == 0x07
+    && chip8_i->MM[(pc + 2) & m] == (0x30 | x) && chip8_i->MM[(pc + 3) & m] == 0x00
+    && chip8_i->MM[(pc + 4) & m] == (0x10 | (pc >> 8)) && chip8_i->MM[(pc + 5) & m] == (pc & 0xFF);
+}
+
+// Drop predecoded instructions overlapping [addr, addr+len), called after every write to main memory
+static void CHIP8_invalidate_range(CHIP8_t *chip8_i, uint32_t addr, uint32_t len) {
+  // an instruction at PC covers PC and PC+1, so the byte before the range can start an affected instruction
+  const uint32_t first = addr ? addr - 1u : 0u;
+  const uint32_t last = addr + len - 1u;
+  for (uint32_t i = first >> 1; i <= (last >> 1); i++) {
+    chip8_i->decode_cache[i & (CHIP8_DECODE_CACHE_SIZE - 1)].tag = 0;
+  }
+  if (chip8_i->blocks) {
+    // any block starting up to a full block length before the write can cover it
+    const uint32_t reach = 2 * CHIP8_BLOCK_MAX_LEN - 1;
+    for (uint32_t pc = addr > reach ? addr - reach : 0; pc <= last; pc++) {
+      CHIP8_block_t *block = &chip8_i->blocks->map[pc & 0xFFF];
+      if (block->tag && (block->tag & 0xFFFF) == pc && pc + 2u * block->len > addr) {
+        block->tag = 0;
+      }
+    }
+  }
+}
+
+// The writes themselves go through mem_mask, so the range is masked the same way and split where it wraps
+void CHIP8_invalidate(CHIP8_t *chip8_i, uint16_t addr, uint16_t len) {
+  const uint32_t start = addr & chip8_i->mem_mask;
+  const uint32_t room = (uint32_t)chip8_i->mem_mask + 1 - start;
+  if (len > room) {
+    CHIP8_invalidate_range(chip8_i, 0, len - room);
+    len = (uint16_t)room;
+  }
+  CHIP8_invalidate_range(chip8_i, start, len);
+}
+
+// Replace the first size bytes of main memory with MM a page at a time, only pages that differ are written and
+// have their predecoded instructions dropped, so going back to a state running the same code keeps the caches warm
+void CHIP8_write_memory(CHIP8_t *chip8_i, const uint8_t *MM, uint32_t size) {
+  for (uint32_t addr = 0; addr < size; addr += CHIP8_MEMORY_PAGE) {
+    const uint32_t len = size - addr < CHIP8_MEMORY_PAGE ? size - addr : CHIP8_MEMORY_PAGE;
+    if (!memcmp(&chip8_i->MM[addr], &MM[addr], len)) continue;
+    memcpy(&chip8_i->MM[addr], &MM[addr], len);
+    CHIP8_invalidate_range(chip8_i, addr, len);
+  }
+}
+
+// Drop everything that was derived from main memory, e.g. after loading a ROM
+void CHIP8_flush_caches(CHIP8_t *chip8_i) {
+  chip8_i->decode_gen += 1;
+  if (chip8_i->decode_gen == 0) {
+    // generation wrapped, old tags could match again
+    memset(chip8_i->decode_cache, 0, sizeof(chip8_i->decode_cache));
+    chip8_i->decode_gen = 1;
+  }
+  if (chip8_i->blocks) {
+    chip8_i->blocks->top = 0;
+    chip8_i->blocks->gen += 1;
+    if (chip8_i->blocks->gen == 0) {
+      memset(chip8_i->blocks->map, 0, sizeof(chip8_i->blocks->map));
+      chip8_i->blocks->gen = 1;
+    }
+  }
+}
+
+// Jump to machine instruction at 0xNNN
+void CHIP8_I_0NNN(CHIP8_t *chip8_i) {
+  chip8_i->PC = chip8_i->instruction.NNN;
+}
+
+// CLS clear screen, the selected planes only
+void CHIP8_I_00E0(CHIP8_t *chip8_i) {
+  for (int p = 0; p < CHIP8_PLANES; p++) {
+    if (chip8_i->planes & (1u << p)) memset(chip8_i->display[p], 0, sizeof(chip8_i->display[p]));
+  }
+  CHIP8_mark_dirty(chip8_i);
+}
+
+// RET from last call
+void CHIP8_I_00EE(CHIP8_t *chip8_i) {
+  if (chip8_i->SP < 1) {
+    CHIP8_fault(chip8_i, CHIP8_FAULT_STACK_UNDERFLOW, chip8_i->PC - 2);
+    return;
+  }
+  chip8_i->SP -= 1;
+  chip8_i->PC = chip8_i->stack[chip8_i->SP];
+}
+
+// JUMP NNN - jump to address 0x0NNN
+void CHIP8_I_1NNN(CHIP8_t *chip8_i) {
+  // a jump to itself never goes anywhere else
+  if ((uint16_t)(chip8_i->PC - 2) == chip8_i->instruction.NNN) CHIP8_idle(chip8_i, 1);
+  chip8_i->PC = chip8_i->instruction.NNN;
+}
+
+// CALL NNN - call subroutine at address 0x0NNN
+void CHIP8_I_2NNN(CHIP8_t *chip8_i) {
+  if (chip8_i->SP >= CHIP8_STACK_SIZE) {
+    CHIP8_fault(chip8_i, CHIP8_FAULT_STACK_OVERFLOW, chip8_i->PC - 2);
+    return;
+  }
+  chip8_i->stack[chip8_i->SP] = chip8_i->PC;
+  chip8_i->SP += 1;
+  chip8_i->PC = chip8_i->instruction.NNN;
+}
+
+// SE Vx, NN - compare register X with 0xNN, skip next instruction if they are equal
+void CHIP8_I_3XNN(CHIP8_t *chip8_i) {
+  if (chip8_i->V[chip8_i->instruction.X] == chip8_i->instruction.NN) {
+    chip8_i->PC += 2;
+  }
+}
+
+// SNE Vx, Vy - compare register X with 0xNN, skip next instruction if they are not equal
+void CHIP8_I_4XNN(CHIP8_t *chip8_i) {
+  if (chip8_i->V[chip8_i->instruction.X] != chip8_i->instruction.NN) {
+    chip8_i->PC += 2;
+  }
+}
+
+// SE Vx, Vy - skip next instruction if the value in register X equals the value in register Y
+void CHIP8_I_5XY0(CHIP8_t *chip8_i) {
+  if (chip8_i->V[chip8_i->instruction.X] == chip8_i->V[chip8_i->instruction.Y]) {
+    chip8_i->PC += 2;
+  }
+}
+
+// LD Vx, NN - set register X to the value NN
+void CHIP8_I_6XNN(CHIP8_t *chip8_i) {
+  chip8_i->V[chip8_i->instruction.X] = chip8_i->instruction.NN; 
+}
+
+// ADD Vx, NN - add NN to the value in register X and store the result in register X
+void CHIP8_I_7XNN(CHIP8_t *chip8_i) {
+  chip8_i->V[chip8_i->instruction.X] += chip8_i->instruction.NN; 
+}
+
+// LD Vx, Vy - store the value in register Y in register X
+void CHIP8_I_8XY0(CHIP8_t *chip8_i) {
+  chip8_i->V[chip8_i->instruction.X] = chip8_i->V[chip8_i->instruction.Y];  
+} 
+
+// ADD Vx, Vy - Add the values in register X and Y and store the result in register X and set carry in register F
+void CHIP8_I_8XY4(CHIP8_t *chip8_i) {
+  uint16_t sum = chip8_i->V[chip8_i->instruction.X] + chip8_i->V[chip8_i->instruction.Y]; 
+  chip8_i->V[chip8_i->instruction.X] = (uint8_t)(sum); 
+  chip8_i->V[0xF] = sum > 0xFF ? 0x1 : 0x0;
+}
+
+// SNE Vx, Vy - skip next instruction if Vx is not equal to Vy
+void CHIP8_I_9XY0(CHIP8_t *chip8_i) {
+  if (chip8_i->V[chip8_i->instruction.X] != chip8_i->V[chip8_i->instruction.Y]) {
+    chip8_i->PC += 2;
+  }
+}
+
+// LD I, NNN - copy NNN to register I, the index register
+void CHIP8_I_ANNN(CHIP8_t *chip8_i) {
+  chip8_i->I = chip8_i->instruction.NNN;
+}
+
+// RND Vx, NN -- get a random number and bitwise AND with the immediate byte 0xNN, store in Vx
+void CHIP8_I_CXNN(CHIP8_t *chip8_i) {
+  chip8_i->V[chip8_i->instruction.X] = CHIP8_rand(chip8_i) & chip8_i->instruction.NN;
+}
+
+// // SKP Vx - skip next instruction if Vx is pressed
+void CHIP8_I_EX9E(CHIP8_t *chip8_i) {
+  if (chip8_i->keypad[chip8_i->V[chip8_i->instruction.X] & 0xF]) {
+    chip8_i->PC += 2;
+  } 
+}
+
+// // SKNP Vx - skip next instruction if Vx is not pressed
+void CHIP8_I_EXA1(CHIP8_t *chip8_i) {
+ if (!chip8_i->keypad[chip8_i->V[chip8_i->instruction.X] & 0xF]) {
+    chip8_i->PC += 2;
+  } 
+}
+
+// LD Vx, DT - set Vx equal to the delay timer's value
+void CHIP8_I_FX07(CHIP8_t *chip8_i) {
+  chip8_i->V[chip8_i->instruction.X] = chip8_i->D;
+  // D only changes between frames, so until then a wait loop reads the same value every pass
+  if (chip8_i->D && CHIP8_delay_wait(chip8_i, chip8_i->PC - 2)) CHIP8_idle(chip8_i, 3);
+}
+
+// // LD Vx, K - block until a key is pressed, then store the key code in Vx
+void CHIP8_I_FX0A(CHIP8_t *chip8_i) {
+  // pre-decrement so that it returns to this instruction until a key is pressed
+  chip8_i->PC -= 2;
+  for (uint8_t i = 0x0; i <= 0xF; i++){
+    // if a key is pressed, store its index in Vx and then continue program execution (don't return to this instruction)
+    if (chip8_i->keypad[i]) {
+      chip8_i->V[chip8_i->instruction.X] = chip8_i->keypad[i];
+      chip8_i->PC += 2;
+      return;
+    }
+  }
+  // nothing pressed, and the keypad is only updated between frames
+  CHIP8_idle(chip8_i, 1);
+}
+
+// LD DT, Vx - set the delay timer equal to the value of Vx
+void CHIP8_I_FX15(CHIP8_t *chip8_i) {
+  chip8_i->D = chip8_i->V[chip8_i->instruction.X];
+}
+
+// LD ST, Vx - set sound timer equal to the value of Vx
+void CHIP8_I_FX18(CHIP8_t *chip8_i) {
+  chip8_i->S = chip8_i->V[chip8_i->instruction.X];
+}
+
+// ADD I, Vx - add Vx to I and store the result in I
+void CHIP8_I_FX1E(CHIP8_t *chip8_i) {
+  chip8_i->I += chip8_i->V[chip8_i->instruction.X];
+}
+
+// LD F, Vx - set I equal to the location of the sprite for digit in Vx
+void CHIP8_I_FX29(CHIP8_t *chip8_i) {
+  // chip8_i->I = chip8_i->MM[chip8_i->V[chip8_i->instruction.X]]; // since we loaded the font into main memory starting at 0x0
+  // TODO load memory at the canonical location
+  chip8_i->I = chip8_i->V[chip8_i->instruction.X]*5; // font was loaded starting at 0x0, each character is 5 bytes
+}
+
+// LD B, Vx - store BCD representation of Vx in memory locations I...I+2
+void CHIP8_I_FX33(CHIP8_t *chip8_i) {
+  // get base ten digits
+  // hundred's digit
+  chip8_i->MM[chip8_i->I & chip8_i->mem_mask] = chip8_i->V[chip8_i->instruction.X] / 100;
+  // ten's digit
+  chip8_i->MM[(chip8_i->I+1) & chip8_i->mem_mask] = (chip8_i->V[chip8_i->instruction.X] % 100) / 10;
+  // one's digit
+  chip8_i->MM[(chip8_i->I+2) & chip8_i->mem_mask] = chip8_i->V[chip8_i->instruction.X] % 10;
+  CHIP8_invalidate(chip8_i, chip8_i->I, 3);
+}
+
+// SCD N - scroll the selected planes down N rows
+void CHIP8_I_00CN(CHIP8_t *chip8_i) {
+  const int h = CHIP8_display_height(chip8_i), n = chip8_i->instruction.N;
+  for (int p = 0; p < CHIP8_PLANES; p++) {
+    if (!(chip8_i->planes & (1u << p))) continue;
+    memmove(chip8_i->display[p][n], chip8_i->display[p][0], (h - n) * sizeof(chip8_i->display[p][0]));
+    memset(chip8_i->display[p][0], 0, n * sizeof(chip8_i->display[p][0]));
+  }
+  CHIP8_mark_dirty(chip8_i);
+}
+
+// SCU N - scroll the selected planes up N rows
+void CHIP8_I_00DN(CHIP8_t *chip8_i) {
+  const int h = CHIP8_display_height(chip8_i), n = chip8_i->instruction.N;
+  for (int p = 0; p < CHIP8_PLANES; p++) {
+    if (!(chip8_i->planes & (1u << p))) continue;
+    memmove(chip8_i->display[p][0], chip8_i->display[p][n], (h - n) * sizeof(chip8_i->display[p][0]));
+    memset(chip8_i->display[p][h - n], 0, n * sizeof(chip8_i->display[p][0]));
+  }
+  CHIP8_mark_dirty(chip8_i);
+}
+
+// SCR - scroll the selected planes right 4 pixels, whole packed words at a time
+void CHIP8_I_00FB(CHIP8_t *chip8_i) {
+  const int h = CHIP8_display_height(chip8_i);
+  for (int p = 0; p < CHIP8_PLANES; p++) {
+    if (!(chip8_i->planes & (1u << p))) continue;
+    for (int y = 0; y < h; y++) {
+      uint64_t *row = chip8_i->display[p][y];
+      if (chip8_i->hires) row[1] = (row[1] >> 4) | (row[0] << 60);
+      row[0] >>= 4;
+    }
+  }
+  CHIP8_mark_dirty(chip8_i);
+}
+
+// SCL - scroll the selected planes left 4 pixels
+void CHIP8_I_00FC(CHIP8_t *chip8_i) {
+  const int h = CHIP8_display_height(chip8_i);
+  for (int p = 0; p < CHIP8_PLANES; p++) {
+    if (!(chip8_i->planes & (1u << p))) continue;
+    for (int y = 0; y < h; y++) {
+      uint64_t *row = chip8_i->display[p][y];
+      row[0] <<= 4;
+      if (chip8_i->hires) {
+        row[0] |= row[1] >> 60;
+        row[1] <<= 4;
+      }
+    }
+  }
+  CHIP8_mark_dirty(chip8_i);
+}
+
+// EXIT - stop the interpreter, PC stays on this instruction so the rest of the frame idles here
+void CHIP8_I_00FD(CHIP8_t *chip8_i) {
+  chip8_i->PC -= 2;
+  chip8_i->run_state = QUIT;
+}
+
+// switch resolution, which also clears the display
+static void CHIP8_set_hires(CHIP8_t *chip8_i, bool hires) {
+  chip8_i->hires = hires;
+  memset(chip8_i->display, 0, sizeof(chip8_i->display));
+  CHIP8_mark_dirty(chip8_i);
+}
+
+// LOW - 64x32 mode
+void CHIP8_I_00FE(CHIP8_t *chip8_i) {
+  CHIP8_set_hires(chip8_i, false);
+}
+
+// HIGH - 128x64 mode
+void CHIP8_I_00FF(CHIP8_t *chip8_i) {
+  CHIP8_set_hires(chip8_i, true);
+}
+
+// LD HF, Vx - set I to the 8x10 big font digit in Vx
+void CHIP8_I_FX30(CHIP8_t *chip8_i) {
+  chip8_i->I = CHIP8_BIG_FONT + (chip8_i->V[chip8_i->instruction.X] & 0xF) * 10;
+}
+
+// LD R, Vx - store V0 to Vx in the RPL user flags
+void CHIP8_I_FX75(CHIP8_t *chip8_i) {
+  memcpy(chip8_i->flags, chip8_i->V, chip8_i->instruction.X + 1);
+}
+
+// LD Vx, R - read V0 to Vx from the RPL user flags
+void CHIP8_I_FX85(CHIP8_t *chip8_i) {
+  memcpy(chip8_i->V, chip8_i->flags, chip8_i->instruction.X + 1);
+}
+
+// SAVE Vx - Vy - store the registers from X to Y, in either direction, at I without moving I
+void CHIP8_I_5XY2(CHIP8_t *chip8_i) {
+  const int x = chip8_i->instruction.X, y = chip8_i->instruction.Y;
+  const int step = x <= y ? 1 : -1;
+  for (int i = 0, r = x; ; i++, r += step) {
+    chip8_i->MM[(chip8_i->I + i) & chip8_i->mem_mask] = chip8_i->V[r];
+    if (r == y) break;
+  }
+  CHIP8_invalidate(chip8_i, chip8_i->I, (x <= y ? y - x : x - y) + 1);
+}
+
+// LOAD Vx - Vy - read the registers from X to Y, in either direction, from I without moving I
+void CHIP8_I_5XY3(CHIP8_t *chip8_i) {
+  const int x = chip8_i->instruction.X, y = chip8_i->instruction.Y;
+  const int step = x <= y ? 1 : -1;
+  for (int i = 0, r = x; ; i++, r += step) {
+    chip8_i->V[r] = chip8_i->MM[(chip8_i->I + i) & chip8_i->mem_mask];
+    if (r == y) break;
+  }
+}
+
+// LD I, NNNN - the only 4 byte instruction, I is loaded from the word after it
+void CHIP8_I_F000(CHIP8_t *chip8_i) {
+  chip8_i->I = (chip8_i->MM[chip8_i->PC & chip8_i->mem_mask] << 8) | chip8_i->MM[(chip8_i->PC + 1) & chip8_i->mem_mask];
+  chip8_i->PC += 2;
+}
+
+// PLANE N - select the planes later draws, clears and scrolls apply to
+void CHIP8_I_FN01(CHIP8_t *chip8_i) {
+  chip8_i->planes = chip8_i->instruction.X & 0x3;
+}
+
+// XO-CHIP skips step over the whole of a following F000 NNNN
+static inline void CHIP8_skip_long(CHIP8_t *chip8_i) {
+  const bool is_long = chip8_i->MM[chip8_i->PC & chip8_i->mem_mask] == 0xF0 && chip8_i->MM[(chip8_i->PC + 1) & chip8_i->mem_mask] == 0x00;
+  chip8_i->PC += is_long ? 4 : 2;
+}
+
+// XO-CHIP versions of the skips, same conditions as CHIP8_I_3XNN etc.
+static void CHIP8_I_3XNN_xochip(CHIP8_t *chip8_i) {
+  if (chip8_i->V[chip8_i->instruction.X] == chip8_i->instruction.NN) CHIP8_skip_long(chip8_i);
+}
+
+static void CHIP8_I_4XNN_xochip(CHIP8_t *chip8_i) {
+  if (chip8_i->V[chip8_i->instruction.X] != chip8_i->instruction.NN) CHIP8_skip_long(chip8_i);
+}
+
+static void CHIP8_I_5XY0_xochip(CHIP8_t *chip8_i) {
+  if (chip8_i->V[chip8_i->instruction.X] == chip8_i->V[chip8_i->instruction.Y]) CHIP8_skip_long(chip8_i);
+}
+
+static void CHIP8_I_9XY0_xochip(CHIP8_t *chip8_i) {
+  if (chip8_i->V[chip8_i->instruction.X] != chip8_i->V[chip8_i->instruction.Y]) CHIP8_skip_long(chip8_i);
+}
+
+static void CHIP8_I_EX9E_xochip(CHIP8_t *chip8_i) {
+  if (chip8_i->keypad[chip8_i->V[chip8_i->instruction.X] & 0xF]) CHIP8_skip_long(chip8_i);
+}
+
+static void CHIP8_I_EXA1_xochip(CHIP8_t *chip8_i) {
+  if (!chip8_i->keypad[chip8_i->V[chip8_i->instruction.X] & 0xF]) CHIP8_skip_long(chip8_i);
+}
+
+// XOR a sprite row, left aligned in bits, onto a packed display row at column x of a display `words` words wide.
+// Returns the pixels it erased, anything past the right edge is dropped or wrapped to the left
+static inline uint64_t CHIP8_draw_row(uint64_t *row, uint64_t bits, int x, int words, bool wrap) {
+  const int w = x >> 6, off = x & 63;
+  const uint64_t head = bits >> off;
+  const uint64_t tail = off ? bits << (64 - off) : 0;
+  uint64_t erased = row[w] & head;
+  row[w] ^= head;
+  if (tail && (w + 1 < words || wrap)) {
+    uint64_t *next = &row[(w + 1) % words];
+    erased |= *next & tail;
+    *next ^= tail;
+  }
+  return erased;
+}
+
+// DXYN for the SUPER-CHIP and XO-CHIP profiles: either resolution, 16x16 sprites for N = 0 and,
+// for XO-CHIP, one sprite after the other in memory for each selected plane. VF is 1 if any pixel was erased
+static inline void CHIP8_draw_ext(CHIP8_t *chip8_i, bool wrap) {
+  const int w = CHIP8_display_width(chip8_i), h = CHIP8_display_height(chip8_i);
+  const int words = chip8_i->hires ? 2 : 1;
+  const int X = chip8_i->V[chip8_i->instruction.X] % w;
+  const int Y = chip8_i->V[chip8_i->instruction.Y] % h;
+  const bool wide = chip8_i->instruction.N == 0;
+  const int rows = wide ? 16 : chip8_i->instruction.N;
+  uint16_t addr = chip8_i->I;
+  uint64_t erased = 0;
+  for (int p = 0; p < CHIP8_PLANES; p++) {
+    if (!(chip8_i->planes & (1u << p))) continue;
+    for (int y = 0; y < rows; y++) {
+      if (!wrap && Y + y >= h) break;
+      uint64_t bits;
+      if (wide) {
+        bits = (uint64_t)((chip8_i->MM[(addr + 2*y) & chip8_i->mem_mask] << 8) | chip8_i->MM[(addr + 2*y + 1) & chip8_i->mem_mask]) << 48;
+      } else {
+        bits = (uint64_t)chip8_i->MM[(addr + y) & chip8_i->mem_mask] << 56;
+      }
+      erased |= CHIP8_draw_row(chip8_i->display[p][(Y + y) % h], bits, X, words, wrap);
+    }
+    addr += wide ? 32 : rows;
+  }
+  chip8_i->V[0xF] = erased ? 0x1 : 0x0;
+  if (rows) CHIP8_mark_dirty(chip8_i);
+}
+
+const char *const CHIP8_engine_names[CHIP8_ENGINE_COUNT] = {
+  [CHIP8_ENGINE_SWITCH] = "switch",
+  [CHIP8_ENGINE_TABLE] = "table",
+  [CHIP8_ENGINE_CACHED] = "cached",
+  [CHIP8_ENGINE_THREADED] = "threaded"
+};
+
+int CHIP8_engine_from_name(const char *name, CHIP8_engine_t *engine) {
+  for (int i = 0; i < CHIP8_ENGINE_COUNT; i++) {
+    if (!strcmp(name, CHIP8_engine_names[i])) {
+      *engine = (CHIP8_engine_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Opcodes the profile doesn't define
+void CHIP8_I_invalid(CHIP8_t *chip8_i) {
+  CHIP8_fault(chip8_i, CHIP8_FAULT_INVALID_OPCODE, chip8_i->PC - 2);
+}
+
+// 5XYN with N != 0 is ignored
+void CHIP8_I_NOP(CHIP8_t *chip8_i) {
+  (void)chip8_i;
+}
+
+// Handlers whose behaviour depends on the quirk profile. CHIP8_QUIRK_PROFILE instantiates them once per
+// profile with the quirks as constants, so each profile gets its own specialised code and no
+// instruction tests a quirk flag at run time:
+//   shift_vy  8XY6/8XYE shift VY into VX (COSMAC VIP) instead of shifting VX in place
+//   jump_vx   BNNN is BXNN, jumping to XNN + VX instead of NNN + V0
+//   mem_inc   how far FX55/FX65 move I: 0 not at all, 1 by X, 2 by X + 1
+//   wrap      DXYN sprites wrap around the screen edges instead of being clipped
+//   vf_reset  8XY1/8XY2/8XY3 clear VF
+//   ext       instruction set extensions, chip8 (none), schip or xochip, see CHIP8_EXT_HANDLERS_*
+// VF is always written after the result so it wins when X is F
+#define CHIP8_QUIRK_PROFILE(name, shift_vy, jump_vx, mem_inc, wrap, vf_reset, ext) \
+  enum { CHIP8_JUMP_VX_##name = jump_vx }; \
+  /* OR Vx, Vy */ \
+  static void CHIP8_I_8XY1_##name(CHIP8_t *chip8_i) { \
+    chip8_i->V[chip8_i->instruction.X] |= chip8_i->V[chip8_i->instruction.Y]; \
+    if (vf_reset) chip8_i->V[0xF] = 0; \
+  } \
+  /* AND Vx, Vy */ \
+  static void CHIP8_I_8XY2_##name(CHIP8_t *chip8_i) { \
+    chip8_i->V[chip8_i->instruction.X] &= chip8_i->V[chip8_i->instruction.Y]; \
+    if (vf_reset) chip8_i->V[0xF] = 0; \
+  } \
+  /* XOR Vx, Vy */ \
+  static void CHIP8_I_8XY3_##name(CHIP8_t *chip8_i) { \
+    chip8_i->V[chip8_i->instruction.X] ^= chip8_i->V[chip8_i->instruction.Y]; \
+    if (vf_reset) chip8_i->V[0xF] = 0; \
+  } \
+  /* SUB Vx, Vy - VF is 1 when there was no borrow */ \
+  static void CHIP8_I_8XY5_##name(CHIP8_t *chip8_i) { \
+    const uint8_t x = chip8_i->V[chip8_i->instruction.X], y = chip8_i->V[chip8_i->instruction.Y]; \
+    chip8_i->V[chip8_i->instruction.X] = x - y; \
+    chip8_i->V[0xF] = x >= y; \
+  } \
+  /* SHR Vx {, Vy} - VF is the bit shifted out */ \
+  static void CHIP8_I_8XY6_##name(CHIP8_t *chip8_i) { \
+    const uint8_t v = chip8_i->V[shift_vy ? chip8_i->instruction.Y : chip8_i->instruction.X]; \
+    chip8_i->V[chip8_i->instruction.X] = v >> 1; \
+    chip8_i->V[0xF] = v & 0x1; \
+  } \
+  /* SUBN Vx, Vy - Vx = Vy - Vx, VF is 1 when there was no borrow */ \
+  static void CHIP8_I_8XY7_##name(CHIP8_t *chip8_i) { \
+    const uint8_t x = chip8_i->V[chip8_i->instruction.X], y = chip8_i->V[chip8_i->instruction.Y]; \
+    chip8_i->V[chip8_i->instruction.X] = y - x; \
+    chip8_i->V[0xF] = y >= x; \
+  } \
+  /* SHL Vx {, Vy} - VF is the bit shifted out */ \
+  static void CHIP8_I_8XYE_##name(CHIP8_t *chip8_i) { \
+    const uint8_t v = chip8_i->V[shift_vy ? chip8_i->instruction.Y : chip8_i->instruction.X]; \
+    chip8_i->V[chip8_i->instruction.X] = v << 1; \
+    chip8_i->V[0xF] = v >> 7; \
+  } \
+  /* JP V0, NNN or JP Vx, XNN */ \
+  static void CHIP8_I_BNNN_##name(CHIP8_t *chip8_i) { \
+    chip8_i->PC = chip8_i->V[jump_vx ? chip8_i->instruction.X : 0x0] + chip8_i->instruction.NNN; \
+  } \
+  /* DRW Vx, Vy, N - XOR the N byte sprite at I onto the display at (Vx, Vy), VF is set if any pixel was erased */ \
+  static void CHIP8_I_DXYN_##name(CHIP8_t *chip8_i) { \
+    if (CHIP8_EXT_##ext) { \
+      CHIP8_draw_ext(chip8_i, wrap); \
+      return; \
+    } \
+    const uint8_t X = chip8_i->V[chip8_i->instruction.X] % DISPLAY_WIDTH; \
+    const uint8_t Y = chip8_i->V[chip8_i->instruction.Y] % DISPLAY_HEIGHT; \
+    const uint8_t N = chip8_i->instruction.N; \
+    uint64_t erased = 0; \
+    for (int y = 0; y < N; y++) { \
+      if (!(wrap) && (Y+y) >= DISPLAY_HEIGHT) break; \
+      /* the sprite byte in the top 8 bits shifted to column X, bits past the right edge fall off or come back in on the left */ \
+      const uint64_t byte = (uint64_t)chip8_i->MM[(chip8_i->I+y) & chip8_i->mem_mask] << 56; \
+      const uint64_t sprite = (wrap) && X ? (byte >> X) | (byte << (DISPLAY_WIDTH - X)) : byte >> X; \
+      const int row = (wrap) ? (Y+y) % DISPLAY_HEIGHT : Y+y; \
+      erased |= chip8_i->display[0][row][0] & sprite; \
+      chip8_i->display[0][row][0] ^= sprite; \
+    } \
+    chip8_i->V[0xF] = erased ? 0x1 : 0x0; \
+    if (N) CHIP8_mark_dirty(chip8_i); \
+  } \
+  /* LD [I], Vx - store V0 to Vx in memory starting at I */ \
+  static void CHIP8_I_FX55_##name(CHIP8_t *chip8_i) { \
+    for (int i = 0; i <= chip8_i->instruction.X; i++) { \
+      chip8_i->MM[(chip8_i->I + i) & chip8_i->mem_mask] = chip8_i->V[i]; \
+    } \
+    CHIP8_invalidate(chip8_i, chip8_i->I, chip8_i->instruction.X + 1); \
+    chip8_i->I += (mem_inc) == 2 ? chip8_i->instruction.X + 1 : (mem_inc) == 1 ? chip8_i->instruction.X : 0; \
+  } \
+  /* LD Vx, [I] - read V0 to Vx from memory starting at I */ \
+  static void CHIP8_I_FX65_##name(CHIP8_t *chip8_i) { \
+    for (int i = 0; i <= chip8_i->instruction.X; i++) { \
+      chip8_i->V[i] = chip8_i->MM[(chip8_i->I + i) & chip8_i->mem_mask]; \
+    } \
+    chip8_i->I += (mem_inc) == 2 ? chip8_i->instruction.X + 1 : (mem_inc) == 1 ? chip8_i->instruction.X : 0; \
+  } \
+  static const CHIP8_handler_t CHIP8_handlers_##name[CHIP8_OP_COUNT] = { \
+    CHIP8_COMMON_HANDLERS, \
+    CHIP8_EXT_HANDLERS_##ext, \
+    [CHIP8_OP_8XY1] = CHIP8_I_8XY1_##name, \
+    [CHIP8_OP_8XY2] = CHIP8_I_8XY2_##name, \
+    [CHIP8_OP_8XY3] = CHIP8_I_8XY3_##name, \
+    [CHIP8_OP_8XY5] = CHIP8_I_8XY5_##name, \
+    [CHIP8_OP_8XY6] = CHIP8_I_8XY6_##name, \
+    [CHIP8_OP_8XY7] = CHIP8_I_8XY7_##name, \
+    [CHIP8_OP_8XYE] = CHIP8_I_8XYE_##name, \
+    [CHIP8_OP_BNNN] = CHIP8_I_BNNN_##name, \
+    [CHIP8_OP_DXYN] = CHIP8_I_DXYN_##name, \
+    [CHIP8_OP_FX55] = CHIP8_I_FX55_##name, \
+    [CHIP8_OP_FX65] = CHIP8_I_FX65_##name \
+  };
+
+// handlers every profile shares
+#define CHIP8_COMMON_HANDLERS \
+  [CHIP8_OP_0NNN] = CHIP8_I_0NNN, \
+  [CHIP8_OP_00E0] = CHIP8_I_00E0, \
+  [CHIP8_OP_00EE] = CHIP8_I_00EE, \
+  [CHIP8_OP_1NNN] = CHIP8_I_1NNN, \
+  [CHIP8_OP_2NNN] = CHIP8_I_2NNN, \
+  [CHIP8_OP_6XNN] = CHIP8_I_6XNN, \
+  [CHIP8_OP_7XNN] = CHIP8_I_7XNN, \
+  [CHIP8_OP_8XY0] = CHIP8_I_8XY0, \
+  [CHIP8_OP_8XY4] = CHIP8_I_8XY4, \
+  [CHIP8_OP_ANNN] = CHIP8_I_ANNN, \
+  [CHIP8_OP_CXNN] = CHIP8_I_CXNN, \
+  [CHIP8_OP_FX07] = CHIP8_I_FX07, \
+  [CHIP8_OP_FX0A] = CHIP8_I_FX0A, \
+  [CHIP8_OP_FX15] = CHIP8_I_FX15, \
+  [CHIP8_OP_FX18] = CHIP8_I_FX18, \
+  [CHIP8_OP_FX1E] = CHIP8_I_FX1E, \
+  [CHIP8_OP_FX29] = CHIP8_I_FX29, \
+  [CHIP8_OP_FX33] = CHIP8_I_FX33, \
+  [CHIP8_OP_NOP] = CHIP8_I_NOP, \
+  [CHIP8_OP_INVALID] = CHIP8_I_invalid
+
+// the instructions each extension level adds, and the CHIP-8 meaning of their opcodes for the profiles without them
+#define CHIP8_EXT_chip8 0
+#define CHIP8_EXT_HANDLERS_chip8 \
+  [CHIP8_OP_3XNN] = CHIP8_I_3XNN, \
+  [CHIP8_OP_4XNN] = CHIP8_I_4XNN, \
+  [CHIP8_OP_5XY0] = CHIP8_I_5XY0, \
+  [CHIP8_OP_9XY0] = CHIP8_I_9XY0, \
+  [CHIP8_OP_EX9E] = CHIP8_I_EX9E, \
+  [CHIP8_OP_EXA1] = CHIP8_I_EXA1, \
+  [CHIP8_OP_00CN] = CHIP8_I_0NNN, \
+  [CHIP8_OP_00FB] = CHIP8_I_0NNN, \
+  [CHIP8_OP_00FC] = CHIP8_I_0NNN, \
+  [CHIP8_OP_00FD] = CHIP8_I_0NNN, \
+  [CHIP8_OP_00FE] = CHIP8_I_0NNN, \
+  [CHIP8_OP_00FF] = CHIP8_I_0NNN, \
+  [CHIP8_OP_FX30] = CHIP8_I_invalid, \
+  [CHIP8_OP_FX75] = CHIP8_I_invalid, \
+  [CHIP8_OP_FX85] = CHIP8_I_invalid, \
+  [CHIP8_OP_00DN] = CHIP8_I_0NNN, \
+  [CHIP8_OP_5XY2] = CHIP8_I_NOP, \
+  [CHIP8_OP_5XY3] = CHIP8_I_NOP, \
+  [CHIP8_OP_F000] = CHIP8_I_invalid, \
+  [CHIP8_OP_FN01] = CHIP8_I_invalid
+
+#define CHIP8_EXT_schip 1
+#define CHIP8_EXT_HANDLERS_schip \
+  [CHIP8_OP_3XNN] = CHIP8_I_3XNN, \
+  [CHIP8_OP_4XNN] = CHIP8_I_4XNN, \
+  [CHIP8_OP_5XY0] = CHIP8_I_5XY0, \
+  [CHIP8_OP_9XY0] = CHIP8_I_9XY0, \
+  [CHIP8_OP_EX9E] = CHIP8_I_EX9E, \
+  [CHIP8_OP_EXA1] = CHIP8_I_EXA1, \
+  [CHIP8_OP_00CN] = CHIP8_I_00CN, \
+  [CHIP8_OP_00FB] = CHIP8_I_00FB, \
+  [CHIP8_OP_00FC] = CHIP8_I_00FC, \
+  [CHIP8_OP_00FD] = CHIP8_I_00FD, \
+  [CHIP8_OP_00FE] = CHIP8_I_00FE, \
+  [CHIP8_OP_00FF] = CHIP8_I_00FF, \
+  [CHIP8_OP_FX30] = CHIP8_I_FX30, \
+  [CHIP8_OP_FX75] = CHIP8_I_FX75, \
+  [CHIP8_OP_FX85] = CHIP8_I_FX85, \
+  [CHIP8_OP_00DN] = CHIP8_I_0NNN, \
+  [CHIP8_OP_5XY2] = CHIP8_I_NOP, \
+  [CHIP8_OP_5XY3] = CHIP8_I_NOP, \
+  [CHIP8_OP_F000] = CHIP8_I_invalid, \
+  [CHIP8_OP_FN01] = CHIP8_I_invalid
+
+#define CHIP8_EXT_xochip 2
+#define CHIP8_EXT_HANDLERS_xochip \
+  [CHIP8_OP_3XNN] = CHIP8_I_3XNN_xochip, \
+  [CHIP8_OP_4XNN] = CHIP8_I_4XNN_xochip, \
+  [CHIP8_OP_5XY0] = CHIP8_I_5XY0_xochip, \
+  [CHIP8_OP_9XY0] = CHIP8_I_9XY0_xochip, \
+  [CHIP8_OP_EX9E] = CHIP8_I_EX9E_xochip, \
+  [CHIP8_OP_EXA1] = CHIP8_I_EXA1_xochip, \
+  [CHIP8_OP_00CN] = CHIP8_I_00CN, \
+  [CHIP8_OP_00FB] = CHIP8_I_00FB, \
+  [CHIP8_OP_00FC] = CHIP8_I_00FC, \
+  [CHIP8_OP_00FD] = CHIP8_I_00FD, \
+  [CHIP8_OP_00FE] = CHIP8_I_00FE, \
+  [CHIP8_OP_00FF] = CHIP8_I_00FF, \
+  [CHIP8_OP_FX30] = CHIP8_I_FX30, \
+  [CHIP8_OP_FX75] = CHIP8_I_FX75, \
+  [CHIP8_OP_FX85] = CHIP8_I_FX85, \
+  [CHIP8_OP_00DN] = CHIP8_I_00DN, \
+  [CHIP8_OP_5XY2] = CHIP8_I_5XY2, \
+  [CHIP8_OP_5XY3] = CHIP8_I_5XY3, \
+  [CHIP8_OP_F000] = CHIP8_I_F000, \
+  [CHIP8_OP_FN01] = CHIP8_I_FN01
+
+//                 name    shift_vy jump_vx mem_inc wrap vf_reset ext
+CHIP8_QUIRK_PROFILE(modern, 0,       0,      0,      0,   0,       chip8)
+CHIP8_QUIRK_PROFILE(vip,    1,       0,      2,      0,   1,       chip8)
+CHIP8_QUIRK_PROFILE(chip48, 0,       1,      1,      0,   0,       chip8)
+CHIP8_QUIRK_PROFILE(schip,  0,       1,      0,      0,   0,       schip)
+CHIP8_QUIRK_PROFILE(xochip, 1,       0,      2,      1,   0,       xochip)
+
+// handler table of every profile, indexed by CHIP8_quirks_t
+const CHIP8_handler_t *const CHIP8_quirk_handlers[CHIP8_QUIRKS_COUNT] = {
+  [CHIP8_QUIRKS_MODERN] = CHIP8_handlers_modern,
+  [CHIP8_QUIRKS_VIP] = CHIP8_handlers_vip,
+  [CHIP8_QUIRKS_CHIP48] = CHIP8_handlers_chip48,
+  [CHIP8_QUIRKS_SCHIP] = CHIP8_handlers_schip,
+  [CHIP8_QUIRKS_XOCHIP] = CHIP8_handlers_xochip
+};
+
+// profiles where BNNN is BXNN, for the disassembler
+const bool CHIP8_quirk_jump_vx[CHIP8_QUIRKS_COUNT] = {
+  [CHIP8_QUIRKS_MODERN] = CHIP8_JUMP_VX_modern,
+  [CHIP8_QUIRKS_VIP] = CHIP8_JUMP_VX_vip,
+  [CHIP8_QUIRKS_CHIP48] = CHIP8_JUMP_VX_chip48,
+  [CHIP8_QUIRKS_SCHIP] = CHIP8_JUMP_VX_schip,
+  [CHIP8_QUIRKS_XOCHIP] = CHIP8_JUMP_VX_xochip
+};
+
+const char *const CHIP8_quirks_names[CHIP8_QUIRKS_COUNT] = {
+  [CHIP8_QUIRKS_MODERN] = "modern",
+  [CHIP8_QUIRKS_VIP] = "vip",
+  [CHIP8_QUIRKS_CHIP48] = "chip48",
+  [CHIP8_QUIRKS_SCHIP] = "schip",
+  [CHIP8_QUIRKS_XOCHIP] = "xochip"
+};
+
+int CHIP8_quirks_from_name(const char *name, CHIP8_quirks_t *quirks) {
+  for (int i = 0; i < CHIP8_QUIRKS_COUNT; i++) {
+    if (!strcmp(name, CHIP8_quirks_names[i])) {
+      *quirks = (CHIP8_quirks_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Pick the handler table once, every engine dispatches through it from then on
+void CHIP8_set_quirks(CHIP8_t *chip8_i, CHIP8_quirks_t quirks) {
+  chip8_i->quirks = quirks;
+  chip8_i->handlers = CHIP8_quirk_handlers[quirks];
+  chip8_i->mem_mask = quirks == CHIP8_QUIRKS_XOCHIP ? CHIP8_MEMORY_SIZE - 1 : 0xFFF;
+}
+
+// printable instruction class names, indexed by CHIP8_op_t
+const char *const CHIP8_op_names[CHIP8_OP_COUNT] = {
+  "0NNN", "00E0", "00EE", "1NNN", "2NNN",
+  "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+  "8XY0", "8XY1", "8XY2", "8XY3", "8XY4",
+  "8XY5", "8XY6", "8XY7", "8XYE", "9XY0",
+  "ANNN", "BNNN", "CXNN", "DXYN", "EX9E",
+  "EXA1", "FX07", "FX0A", "FX15", "FX18",
+  "FX1E", "FX29", "FX33", "FX55", "FX65",
+  "00CN", "00FB", "00FC", "00FD", "00FE",
+  "00FF", "FX30", "FX75", "FX85",
+  "00DN", "5XY2", "5XY3", "F000", "FN01",
+  "NOP", "INVALID"
+};
+
+
+// instruction class of every possible opcode, filled once by CHIP8_build_dispatch
+uint8_t CHIP8_optable[0x10000];
+
+// Map an opcode to its instruction class, same nesting as the switch interpreter
+CHIP8_op_t CHIP8_decode_op(uint16_t opcode) {
+  switch ((opcode & 0xF000) >> 12) {
+    case 0x0:
+      switch (opcode & 0xFFF) {
+        case 0x0E0: return CHIP8_OP_00E0;
+        case 0x0EE: return CHIP8_OP_00EE;
+        case 0x0FB: return CHIP8_OP_00FB;
+        case 0x0FC: return CHIP8_OP_00FC;
+        case 0x0FD: return CHIP8_OP_00FD;
+        case 0x0FE: return CHIP8_OP_00FE;
+        case 0x0FF: return CHIP8_OP_00FF;
+        default:
+          if ((opcode & 0xFF0) == 0x0C0) return CHIP8_OP_00CN;
+          if ((opcode & 0xFF0) == 0x0D0) return CHIP8_OP_00DN;
+          return CHIP8_OP_0NNN;
+      }
+    case 0x1: return CHIP8_OP_1NNN;
+    case 0x2: return CHIP8_OP_2NNN;
+    case 0x3: return CHIP8_OP_3XNN;
+    case 0x4: return CHIP8_OP_4XNN;
+    case 0x5:
+      switch (opcode & 0xF) {
+        case 0x0: return CHIP8_OP_5XY0;
+        case 0x2: return CHIP8_OP_5XY2;
+        case 0x3: return CHIP8_OP_5XY3;
+        default:  return CHIP8_OP_NOP;
+      }
+    case 0x6: return CHIP8_OP_6XNN;
+    case 0x7: return CHIP8_OP_7XNN;
+    case 0x8:
+      switch (opcode & 0xF) {
+        case 0x0: return CHIP8_OP_8XY0;
+        case 0x1: return CHIP8_OP_8XY1;
+        case 0x2: return CHIP8_OP_8XY2;
+        case 0x3: return CHIP8_OP_8XY3;
+        case 0x4: return CHIP8_OP_8XY4;
+        case 0x5: return CHIP8_OP_8XY5;
+        case 0x6: return CHIP8_OP_8XY6;
+        case 0x7: return CHIP8_OP_8XY7;
+        case 0xE: return CHIP8_OP_8XYE;
+        default:  return CHIP8_OP_INVALID;
+      }
+    case 0x9: return CHIP8_OP_9XY0;
+    case 0xA: return CHIP8_OP_ANNN;
+    case 0xB: return CHIP8_OP_BNNN;
+    case 0xC: return CHIP8_OP_CXNN;
+    case 0xD: return CHIP8_OP_DXYN;
+    case 0xE:
+      switch (opcode & 0xFF) {
+        case 0x9E: return CHIP8_OP_EX9E;
+        case 0xA1: return CHIP8_OP_EXA1;
+        default:   return CHIP8_OP_INVALID;
+      }
+    case 0xF:
+      if (opcode == 0xF000) return CHIP8_OP_F000;
+      // XO-CHIP audio pattern and pitch, accepted and ignored, the beeper stays a square wave
+      if (opcode == 0xF002 || (opcode & 0xFF) == 0x3A) return CHIP8_OP_NOP;
+      switch (opcode & 0xFF) {
+        case 0x01: return CHIP8_OP_FN01;
+        case 0x07: return CHIP8_OP_FX07;
+        case 0x0A: return CHIP8_OP_FX0A;
+        case 0x15: return CHIP8_OP_FX15;
+        case 0x18: return CHIP8_OP_FX18;
+        case 0x1E: return CHIP8_OP_FX1E;
+        case 0x29: return CHIP8_OP_FX29;
+        case 0x33: return CHIP8_OP_FX33;
+        case 0x55: return CHIP8_OP_FX55;
+        case 0x65: return CHIP8_OP_FX65;
+        case 0x30: return CHIP8_OP_FX30;
+        case 0x75: return CHIP8_OP_FX75;
+        case 0x85: return CHIP8_OP_FX85;
+        default:   return CHIP8_OP_INVALID;
+      }
+  }
+  return CHIP8_OP_INVALID;
+}
+
+// Decode every opcode once so the table interpreter costs a single indirect call per instruction
+void CHIP8_build_dispatch(void) {
+  static bool built = false;
+  if (built) return;
+  for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++) {
+    CHIP8_optable[opcode] = CHIP8_decode_op(opcode);
+  }
+  built = true;
+}
+
+// fetch the instruction at PC and split it into its operand fields, false if PC has left main memory
+static inline bool CHIP8_fetch(CHIP8_t *chip8_i) {
+  if (chip8_i->PC >= chip8_i->mem_mask) {
+    // the instruction would straddle the end of main memory
+    CHIP8_fault(chip8_i, CHIP8_FAULT_PC_RANGE, chip8_i->PC);
+    return false;
+  }
+  // left shift fills zeroes then OR with next byte in chip8 big endian to convert to x86 little endian
+  // fetch
+  chip8_i->instruction.opcode = (chip8_i->MM[chip8_i->PC & chip8_i->mem_mask] << 8) | chip8_i->MM[(chip8_i->PC+1) & chip8_i->mem_mask];
+  chip8_i->PC += 2; // increment PC
+  // decode
+  chip8_i->instruction.NNN = chip8_i->instruction.opcode & 0xFFF;
+  chip8_i->instruction.NN = chip8_i->instruction.opcode & 0xFF;
+  chip8_i->instruction.N = chip8_i->instruction.opcode & 0xF;
+  chip8_i->instruction.X = (chip8_i->instruction.opcode & 0x0F00) >> 8;
+  chip8_i->instruction.Y = (chip8_i->instruction.opcode & 0x00F0) >> 4;
+  CHIP8_STAT_EXEC(chip8_i, chip8_i->PC - 2, CHIP8_optable[chip8_i->instruction.opcode]);
+  CHIP8_TRACE_EXEC(chip8_i, chip8_i->PC - 2, chip8_i->instruction.opcode);
+  return true;
+}
+
+// Original interpreter, kept as an engine to compare against the table dispatch
+static inline void CHIP8_emulate_instruction_switch(CHIP8_t *chip8_i) {
+  // execute (technically I think selecting the instruction is still decode, but I can't think of a bettery way to separate them atm)
+  switch ((chip8_i->instruction.opcode & 0xF000) >> 12) {
+    case 0x0:
+      switch(chip8_i->instruction.NNN) {
+        case 0x0E0:
+          CHIP8_I_00E0(chip8_i);
+          break;
+        case 0x0EE:
+          CHIP8_I_00EE(chip8_i);
+          break;
+        default:
+          // 0NNN or an extension the profile may or may not have
+          chip8_i->handlers[CHIP8_optable[chip8_i->instruction.opcode]](chip8_i);
+      }
+      break;
+    case 0x1:
+      CHIP8_I_1NNN(chip8_i);
+      break;
+    case 0x2:
+      CHIP8_I_2NNN(chip8_i);
+      break;
+    case 0x3:
+      chip8_i->handlers[CHIP8_OP_3XNN](chip8_i);
+      break;
+    case 0x4:
+      chip8_i->handlers[CHIP8_OP_4XNN](chip8_i);
+      break;
+    case 0x5:
+      chip8_i->handlers[CHIP8_optable[chip8_i->instruction.opcode]](chip8_i);
+      break;
+    case 0x6:
+      CHIP8_I_6XNN(chip8_i);
+      break;
+    case 0x7:
+      CHIP8_I_7XNN(chip8_i);
+      break;
+    case 0x8:
+      switch(chip8_i->instruction.N) {
+        case 0x0:
+          CHIP8_I_8XY0(chip8_i);
+          break;
+        case 0x1:
+          chip8_i->handlers[CHIP8_OP_8XY1](chip8_i);
+          break;
+        case 0x2:
+          chip8_i->handlers[CHIP8_OP_8XY2](chip8_i);
+          break;
+        case 0x3:
+          chip8_i->handlers[CHIP8_OP_8XY3](chip8_i);
+          break;
+        case 0x4:
+          CHIP8_I_8XY4(chip8_i);
+          break;
+        case 0x5:
+          chip8_i->handlers[CHIP8_OP_8XY5](chip8_i);
+          break;
+        case 0x6:
+          chip8_i->handlers[CHIP8_OP_8XY6](chip8_i);
+          break;
+        case 0x7:
+          chip8_i->handlers[CHIP8_OP_8XY7](chip8_i);
+          break;
+        case 0xE:
+          chip8_i->handlers[CHIP8_OP_8XYE](chip8_i);
+          break;
+        default:
+          CHIP8_I_invalid(chip8_i);
+      }
+      break;
+    case 0x9:
+      chip8_i->handlers[CHIP8_OP_9XY0](chip8_i);
+      break;
+    case 0xA:
+      CHIP8_I_ANNN(chip8_i);
+      break;
+    case 0xB:
+      chip8_i->handlers[CHIP8_OP_BNNN](chip8_i);
+      break;
+    case 0xC:
+      CHIP8_I_CXNN(chip8_i);
+      break;
+    case 0xD:
+      chip8_i->handlers[CHIP8_OP_DXYN](chip8_i);
+      break;
+    case 0xE:
+      switch(chip8_i->instruction.NN) {
+        case 0x9E:
+          chip8_i->handlers[CHIP8_OP_EX9E](chip8_i);
+          break;
+        case 0xA1:
+          chip8_i->handlers[CHIP8_OP_EXA1](chip8_i);
+          break;
+          default: 
+            CHIP8_I_invalid(chip8_i);
+        }
+      break;
+    case 0xF:
+      switch(chip8_i->instruction.NN) {
+        case 0x07:
+          CHIP8_I_FX07(chip8_i);
+          break;
+        case 0x0A:
+          CHIP8_I_FX0A(chip8_i);
+          break;
+        case 0x15:
+          CHIP8_I_FX15(chip8_i);
+          break;
+        case 0x18:
+          CHIP8_I_FX18(chip8_i);
+          break;
+        case 0x1E:
+          CHIP8_I_FX1E(chip8_i);
+          break;
+        case 0x29:
+          CHIP8_I_FX29(chip8_i);
+          break;
+        case 0x33:
+          CHIP8_I_FX33(chip8_i);
+          break;
+        case 0x55:
+          chip8_i->handlers[CHIP8_OP_FX55](chip8_i);
+          break;
+        case 0x65:
+          chip8_i->handlers[CHIP8_OP_FX65](chip8_i);
+          break;
+        default:
+          // extensions, or invalid for profiles without them
+          chip8_i->handlers[CHIP8_optable[chip8_i->instruction.opcode]](chip8_i);
+      }
+      break; 
+    default:
+      CHIP8_I_invalid(chip8_i);
+  }
+}
+
+
+// Table interpreter, the decode switch was run ahead of time by CHIP8_build_dispatch
+static inline void CHIP8_emulate_instruction_table(CHIP8_t *chip8_i) {
+  chip8_i->handlers[CHIP8_optable[chip8_i->instruction.opcode]](chip8_i);
+}
+
+// Cached interpreter, fetch and decode only happen the first time an address is executed
+static inline void CHIP8_emulate_instruction_cached(CHIP8_t *chip8_i) {
+  CHIP8_decoded_t *entry = &chip8_i->decode_cache[(chip8_i->PC >> 1) & (CHIP8_DECODE_CACHE_SIZE - 1)];
+  const uint32_t tag = ((uint32_t)chip8_i->decode_gen << 16) | chip8_i->PC;
+  if (entry->tag == tag) {
+    chip8_i->instruction = entry->instruction;
+    chip8_i->PC += 2;
+    CHIP8_STAT_EXEC(chip8_i, chip8_i->PC - 2, entry->op);
+    CHIP8_TRACE_EXEC(chip8_i, chip8_i->PC - 2, chip8_i->instruction.opcode);
+  } else {
+    // only instructions inside main memory are ever cached, so PC only needs checking on a miss
+    if (!CHIP8_fetch(chip8_i)) return;
+    entry->instruction = chip8_i->instruction;
+    entry->op = CHIP8_optable[chip8_i->instruction.opcode];
+    entry->tag = tag;
+  }
+  chip8_i->handlers[entry->op](chip8_i);
+}
+
+// Instructions that change control flow or write memory end a block, the next block is looked up by the new PC
+static inline bool CHIP8_ends_block(uint8_t op) {
+  switch (op) {
+    case CHIP8_OP_0NNN: case CHIP8_OP_00EE: case CHIP8_OP_1NNN: case CHIP8_OP_2NNN: case CHIP8_OP_BNNN:
+    case CHIP8_OP_3XNN: case CHIP8_OP_4XNN: case CHIP8_OP_5XY0: case CHIP8_OP_9XY0:
+    case CHIP8_OP_EX9E: case CHIP8_OP_EXA1: case CHIP8_OP_FX0A:
+    case CHIP8_OP_FX33: case CHIP8_OP_FX55: case CHIP8_OP_INVALID:
+    case CHIP8_OP_00FD: case CHIP8_OP_5XY2: case CHIP8_OP_F000:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Translate the block starting at pc, labels maps op classes to the threaded handlers (NULL = generic handler call).
+// The inlined handlers are the CHIP-8 ones, ops the profile replaces always take the generic call
+static CHIP8_block_t *CHIP8_translate(CHIP8_t *chip8_i, uint16_t pc, const void *const *labels, const void *generic, const void *end) {
+  struct CHIP8_blocks_s *blocks = chip8_i->blocks;
+  if (blocks->top + CHIP8_BLOCK_MAX_LEN + 1 > CHIP8_BLOCK_POOL_SIZE) {
+    CHIP8_flush_caches(chip8_i);
+  }
+  CHIP8_block_t *block = &blocks->map[pc & 0xFFF];
+  block->tag = ((uint32_t)blocks->gen << 16) | pc;
+  block->first = blocks->top;
+  block->len = 0;
+  CHIP8_top_t *top = &blocks->pool[blocks->top];
+  // stop before an instruction that would straddle the end of main memory
+  while (block->len < CHIP8_BLOCK_MAX_LEN && pc < chip8_i->mem_mask) {
+    const uint16_t opcode = (chip8_i->MM[pc] << 8) | chip8_i->MM[pc+1];
+    top->instruction.opcode = opcode;
+    top->instruction.NNN = opcode & 0xFFF;
+    top->instruction.NN = opcode & 0xFF;
+    top->instruction.N = opcode & 0xF;
+    top->instruction.X = (opcode & 0x0F00) >> 8;
+    top->instruction.Y = (opcode & 0x00F0) >> 4;
+    top->op = CHIP8_optable[opcode];
+    top->label = labels[top->op] && chip8_i->handlers[top->op] == CHIP8_handlers_modern[top->op] ? labels[top->op] : generic;
+    // the handlers are what recognise idle loops, see CHIP8_idle
+    if ((top->op == CHIP8_OP_1NNN && top->instruction.NNN == pc) || (top->op == CHIP8_OP_FX07 && CHIP8_delay_wait(chip8_i, pc))) {
+      top->label = generic;
+    }
+    top++;
+    pc += 2;
+    block->len += 1;
+    // an extension the profile doesn't have runs as a jump (0NNN) or a fault, either way the block ends there
+    const CHIP8_handler_t handler = chip8_i->handlers[CHIP8_optable[opcode]];
+    if (CHIP8_ends_block(CHIP8_optable[opcode]) || handler == CHIP8_I_0NNN || handler == CHIP8_I_invalid) break;
+  }
+  top->label = end;
+  top->op = CHIP8_OP_COUNT; // not an instruction, dispatching to it ends the block
+  blocks->top += block->len + 1;
+  return block;
+}
+
+// Threaded engine, executes whole translated blocks while the instruction budget allows and single steps the rest.
+// The budget is kept in a local and only written back around handler calls, like PC.
+static void CHIP8_run_threaded(CHIP8_t *chip8_i) {
+  // simple instructions are inlined, everything else goes through the profile's handler table so behaviour can't drift
+  static const void *const labels[CHIP8_OP_COUNT] = {
+    [CHIP8_OP_1NNN] = &&op_1NNN,
+    [CHIP8_OP_3XNN] = &&op_3XNN,
+    [CHIP8_OP_4XNN] = &&op_4XNN,
+    [CHIP8_OP_5XY0] = &&op_5XY0,
+    [CHIP8_OP_6XNN] = &&op_6XNN,
+    [CHIP8_OP_7XNN] = &&op_7XNN,
+    [CHIP8_OP_8XY0] = &&op_8XY0,
+    [CHIP8_OP_8XY4] = &&op_8XY4,
+    [CHIP8_OP_9XY0] = &&op_9XY0,
+    [CHIP8_OP_ANNN] = &&op_ANNN,
+    [CHIP8_OP_FX07] = &&op_FX07,
+    [CHIP8_OP_FX15] = &&op_FX15,
+    [CHIP8_OP_FX18] = &&op_FX18,
+    [CHIP8_OP_FX1E] = &&op_FX1E,
+    [CHIP8_OP_FX29] = &&op_FX29
+  };
+  // PC is kept in a local and only written back around handler calls
+  #define DISPATCH() do { \
+    CHIP8_STAT_EXEC(chip8_i, pc, top->op); \
+    if (chip8_i->trace && top->op != CHIP8_OP_COUNT) CHIP8_trace_exec(chip8_i->trace, chip8_i, pc, I_.opcode); \
+    goto *top->label; \
+  } while (0)
+  #define NEXT() do { top++; DISPATCH(); } while (0)
+  #define I_ (top->instruction)
+
+  if (chip8_i->blocks == NULL) {
+    chip8_i->blocks = calloc(1, sizeof(struct CHIP8_blocks_s));
+    if (chip8_i->blocks == NULL) {
+      fprintf(stderr, "Could not allocate block cache, falling back to the cached engine\n");
+      chip8_i->engine = CHIP8_ENGINE_CACHED;
+      while (chip8_i->budget && chip8_i->run_state != QUIT) {
+        chip8_i->budget--;
+        CHIP8_emulate_instruction_cached(chip8_i);
+      }
+      return;
+    }
+    chip8_i->blocks->gen = 1;
+  }
+  struct CHIP8_blocks_s *blocks = chip8_i->blocks;
+  const CHIP8_top_t *top;
+  uint8_t *V = chip8_i->V;
+  const CHIP8_handler_t *handlers = chip8_i->handlers;
+  uint16_t pc = chip8_i->PC;
+  uint64_t left = chip8_i->budget;
+
+  // every instruction that can quit or fault ends its block, so checking between blocks is enough
+  while (left && chip8_i->run_state != QUIT) {
+    if (pc >= chip8_i->mem_mask) {
+      // the instruction would straddle the end of main memory
+      CHIP8_fault(chip8_i, CHIP8_FAULT_PC_RANGE, pc);
+      left--;
+      break;
+    }
+    CHIP8_block_t *block = &blocks->map[pc & 0xFFF];
+    if (block->tag != (((uint32_t)blocks->gen << 16) | pc)) {
+      block = CHIP8_translate(chip8_i, pc, labels, &&op_generic, &&block_end);
+    }
+    if (block->len > left) {
+      // not enough budget left for the whole block, finish instruction by instruction
+      chip8_i->PC = pc;
+      chip8_i->budget = left;
+      while (chip8_i->budget && chip8_i->run_state != QUIT) {
+        chip8_i->budget--;
+        CHIP8_emulate_instruction_cached(chip8_i);
+      }
+      return;
+    }
+    left -= block->len;
+    top = &blocks->pool[block->first];
+    DISPATCH();
+
+    op_generic:
+      chip8_i->instruction = I_;
+      chip8_i->PC = pc + 2;
+      // the rest of the block is already paid for, an idle loop can only skip what comes after it
+      chip8_i->budget = left;
+      handlers[top->op](chip8_i);
+      left = chip8_i->budget;
+      pc = chip8_i->PC;
+      NEXT();
+    op_1NNN:
+      pc = I_.NNN;
+      NEXT();
+    op_3XNN:
+      pc += (V[I_.X] == I_.NN) ? 4 : 2;
+      NEXT();
+    op_4XNN:
+      pc += (V[I_.X] != I_.NN) ? 4 : 2;
+      NEXT();
+    op_5XY0:
+      pc += (V[I_.X] == V[I_.Y]) ? 4 : 2;
+      NEXT();
+    op_6XNN:
+      V[I_.X] = I_.NN;
+      pc += 2;
+      NEXT();
+    op_7XNN:
+      V[I_.X] += I_.NN;
+      pc += 2;
+      NEXT();
+    op_8XY0:
+      V[I_.X] = V[I_.Y];
+      pc += 2;
+      NEXT();
+    op_8XY4: {
+      uint16_t sum = V[I_.X] + V[I_.Y];
+      V[I_.X] = (uint8_t)(sum);
+      V[0xF] = sum > 0xFF ? 0x1 : 0x0;
+      pc += 2;
+      NEXT();
+    }
+    op_9XY0:
+      pc += (V[I_.X] != V[I_.Y]) ? 4 : 2;
+      NEXT();
+    op_ANNN:
+      chip8_i->I = I_.NNN;
+      pc += 2;
+      NEXT();
+    op_FX07:
+      V[I_.X] = chip8_i->D;
+      pc += 2;
+      NEXT();
+    op_FX15:
+      chip8_i->D = V[I_.X];
+      pc += 2;
+      NEXT();
+    op_FX18:
+      chip8_i->S = V[I_.X];
+      pc += 2;
+      NEXT();
+    op_FX1E:
+      chip8_i->I += V[I_.X];
+      pc += 2;
+      NEXT();
+    op_FX29:
+      chip8_i->I = V[I_.X]*5;
+      pc += 2;
+      NEXT();
+    block_end:
+      continue;
+  }
+  chip8_i->PC = pc;
+  chip8_i->budget = left;
+  #undef I_
+  #undef NEXT
+  #undef DISPATCH
+}
+
+// Emulate an instruction
+void CHIP8_emulate_instruction(CHIP8_t *chip8_i) {
+  switch (chip8_i->engine) {
+    case CHIP8_ENGINE_SWITCH:
+      if (CHIP8_fetch(chip8_i)) CHIP8_emulate_instruction_switch(chip8_i);
+      break;
+    case CHIP8_ENGINE_CACHED:
+    case CHIP8_ENGINE_THREADED: // single steps never form a block
+      CHIP8_emulate_instruction_cached(chip8_i);
+      break;
+    case CHIP8_ENGINE_TABLE:
+    default:
+      if (CHIP8_fetch(chip8_i)) CHIP8_emulate_instruction_table(chip8_i);
+      break;
+  }
+}
+
+// Execute n instructions back to back, no pacing and no timer updates, stopping early if the instance quits or faults.
+// The engine is chosen once per call so the inner loops have no per instruction engine check. The countdown lives in
+// budget rather than a local so an idle loop can skip the passes it has left, see CHIP8_idle.
+void CHIP8_run(CHIP8_t *chip8_i, uint64_t n) {
+  // the tracer numbers instructions itself, cycles is only brought up to date after the batch
+  if (chip8_i->trace) chip8_i->trace->next_cycle = chip8_i->cycles;
+  chip8_i->budget = n;
+  switch (chip8_i->engine) {
+    case CHIP8_ENGINE_SWITCH:
+      while (chip8_i->budget && chip8_i->run_state != QUIT) {
+        chip8_i->budget--;
+        if (CHIP8_fetch(chip8_i)) CHIP8_emulate_instruction_switch(chip8_i);
+      }
+      break;
+    case CHIP8_ENGINE_CACHED:
+      while (chip8_i->budget && chip8_i->run_state != QUIT) {
+        chip8_i->budget--;
+        CHIP8_emulate_instruction_cached(chip8_i);
+      }
+      break;
+    case CHIP8_ENGINE_THREADED:
+      CHIP8_run_threaded(chip8_i);
+      break;
+    case CHIP8_ENGINE_TABLE:
+    default:
+      while (chip8_i->budget && chip8_i->run_state != QUIT) {
+        chip8_i->budget--;
+        if (CHIP8_fetch(chip8_i)) CHIP8_emulate_instruction_table(chip8_i);
+      }
+      break;
+  }
+  // the instruction that quit or faulted counts as executed, and so do the skipped idle passes
+  chip8_i->cycles += n - chip8_i->budget;
+  // single steps outside a batch have nothing to skip
+  chip8_i->budget = 0;
+}
+
+// Delay and sound timers count down at 60 Hz
+void CHIP8_tick_timers(CHIP8_t *chip8_i) {
+  if (chip8_i->D > 0) {
+    chip8_i->D -= 1;
+  }
+  if (chip8_i->S > 0) {
+    chip8_i->S -= 1;
+  }
+}
+
+// One 60 Hz frame of emulated time: 1 60th of the instructions per second, then the timer update
+void CHIP8_emulate_frame(CHIP8_t *chip8_i) {
+  const uint32_t sixtieths = chip8_i->clock_rate + chip8_i->cycle_frac;
+  chip8_i->cycle_frac = sixtieths % 60;
+  CHIP8_run(chip8_i, sixtieths / 60);
+
+  if (chip8_i->fault) {
+    // halted part way, the frame never finishes
+    return;
+  }
+  CHIP8_tick_timers(chip8_i);
+  chip8_i->frames++;
+  CHIP8_STAT_POLL(chip8_i);
+  // the tone follows the timer, on from the tick that leaves S > 0 to the one that reaches 0
+  if (chip8_i->audio) CHIP8_audio_update(chip8_i->audio, chip8_i->frames, chip8_i->S > 0);
+}
+
+// Run whole 60 Hz frames back to back until `cycles` instructions have executed, no pacing or presentation
+void CHIP8_run_headless(CHIP8_t *chip8_i, uint64_t cycles) {
+  chip8_i->run_state = RUNNING;
+  while (chip8_i->run_state == RUNNING && chip8_i->cycles < cycles) {
+    // below 60 Hz some frames hold no instruction at all, they still tick the timers
+    const uint32_t per_frame = CHIP8_frame_length(chip8_i);
+    const uint64_t left = cycles - chip8_i->cycles;
+    if (!chip8_i->clock_rate || (per_frame && left < per_frame)) {
+      CHIP8_run(chip8_i, left);
+    } else {
+      CHIP8_emulate_frame(chip8_i);
+    }
+  }
+}
+
+// FNV-1a over the emulated machine state, two runs with the same hash ended in the same state
+uint64_t CHIP8_state_hash(const CHIP8_t *chip8_i) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  #define HASH_BYTES(ptr, len) \
+    for (size_t b = 0; b < (len); b++) { hash = (hash ^ ((const uint8_t *)(ptr))[b]) * 0x100000001B3ull; }
+  HASH_BYTES(chip8_i->MM, (size_t)chip8_i->mem_mask + 1);
+  HASH_BYTES(chip8_i->V, sizeof(chip8_i->V));
+  const uint16_t regs16[] = { chip8_i->PC, chip8_i->I };
+  HASH_BYTES(regs16, sizeof(regs16));
+  const uint8_t regs8[] = { chip8_i->S, chip8_i->D, chip8_i->SP, chip8_i->cycle_frac, chip8_i->hires, chip8_i->planes };
+  HASH_BYTES(regs8, sizeof(regs8));
+  HASH_BYTES(chip8_i->flags, sizeof(chip8_i->flags));
+  HASH_BYTES(chip8_i->stack, sizeof(chip8_i->stack));
+  HASH_BYTES(chip8_i->display, sizeof(chip8_i->display));
+  #undef HASH_BYTES
+  return hash;
+}
+
+// Human readable dump of the machine state, used at the end of headless runs
+void CHIP8_dump_state(const CHIP8_t *chip8_i, FILE *out) {
+  fprintf(out, "ROM: %s\n", chip8_i->rom);
+  fprintf(out, "cycles: %llu\n", (unsigned long long)chip8_i->cycles);
+  fprintf(out, "seed: %llu\n", (unsigned long long)chip8_i->seed);
+  fprintf(out, "hash: 0x%016llX\n", (unsigned long long)CHIP8_state_hash(chip8_i));
+  if (chip8_i->fault) {
+    fprintf(out, "fault: %s at 0x%04X\n", CHIP8_fault_names[chip8_i->fault], chip8_i->fault_pc);
+  }
+  fprintf(out, "PC: 0x%04X  I: 0x%04X  SP: %u  D: 0x%02X  S: 0x%02X\n", chip8_i->PC, chip8_i->I, chip8_i->SP, chip8_i->D, chip8_i->S);
+  for (int i = 0; i < 0x10; i++) {
+    fprintf(out, "V%X: 0x%02X%s", i, chip8_i->V[i], (i % 8 == 7) ? "\n" : "  ");
+  }
+  fprintf(out, "stack:");
+  for (int i = 0; i < chip8_i->SP && i < CHIP8_STACK_SIZE; i++) {
+    fprintf(out, " 0x%04X", chip8_i->stack[i]);
+  }
+  fprintf(out, "\n");
+  // one character per pixel in the current resolution, colours 2 and 3 only appear with XO-CHIP planes
+  for (int y = 0; y < CHIP8_display_height(chip8_i); y++) {
+    for (int x = 0; x < CHIP8_display_width(chip8_i); x++) {
+      fputc(".#+@"[CHIP8_pixel(chip8_i, x, y)], out);
+    }
+    fputc('\n', out);
+  }
+}
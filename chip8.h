@@ -0,0 +1,225 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// #define ENTRY_POINT 0x200 // entry point for ROM
+#define DISPLAY_WIDTH 64       // low resolution
+#define DISPLAY_HEIGHT 32
+#define DISPLAY_MAX_WIDTH 128  // SUPER-CHIP/XO-CHIP high resolution
+#define DISPLAY_MAX_HEIGHT 64
+#define DISPLAY_WORDS (DISPLAY_MAX_WIDTH / 64) // uint64_t per packed display row
+#define CHIP8_PLANES 2         // XO-CHIP bitplanes, 4 colours
+#define CHIP8_MEMORY_SIZE 0x10000 // XO-CHIP address space, the other profiles mirror the first 4K of it
+#define CHIP8_MEMORY_PAGE 0x100   // granularity CHIP8_write_memory compares and invalidates at
+#define CHIP8_BIG_FONT 0x50    // SUPER-CHIP 8x10 digits, after the 4x5 font at 0
+#define CHIP8_STACK_SIZE 12
+
+typedef enum {
+  QUIT,
+  RUNNING,
+  STOPPED
+} e_state_t;
+
+// Why an instance halted itself, a fault sets run_state to QUIT with PC left on the faulting instruction
+typedef enum {
+  CHIP8_FAULT_NONE,
+  CHIP8_FAULT_STACK_OVERFLOW,  // 2NNN with all 12 levels in use
+  CHIP8_FAULT_STACK_UNDERFLOW, // 00EE with nothing to return to
+  CHIP8_FAULT_PC_RANGE,        // the next instruction would be fetched from past the end of memory
+  CHIP8_FAULT_INVALID_OPCODE,  // an opcode the quirk profile doesn't define
+  CHIP8_FAULT_COUNT
+} CHIP8_fault_t;
+
+// Interpreter used by CHIP8_run/CHIP8_emulate_instruction, all engines give identical results
+typedef enum {
+  CHIP8_ENGINE_SWITCH, // nested switch on the opcode nibbles
+  CHIP8_ENGINE_TABLE,  // opcode -> handler table built at startup
+  CHIP8_ENGINE_CACHED, // predecoded instructions cached per PC, filled lazily
+  CHIP8_ENGINE_THREADED, // basic blocks translated to direct threaded code (computed goto)
+  CHIP8_ENGINE_COUNT
+} CHIP8_engine_t;
+
+// Quirk profiles, the behaviours the CHIP8 variants disagree on, see CHIP8_QUIRK_PROFILE in chip8.c
+typedef enum {
+  CHIP8_QUIRKS_MODERN, // what most current ROMs and test suites expect
+  CHIP8_QUIRKS_VIP,    // original COSMAC VIP interpreter
+  CHIP8_QUIRKS_CHIP48, // HP48 CHIP-48
+  CHIP8_QUIRKS_SCHIP,  // SUPER-CHIP 1.1, with its high resolution, scrolling and big font extensions
+  CHIP8_QUIRKS_XOCHIP, // XO-CHIP, VIP like but sprites wrap, with the SUPER-CHIP and XO-CHIP extensions
+  CHIP8_QUIRKS_COUNT
+} CHIP8_quirks_t;
+
+// Instruction classes, one per handler
+typedef enum {
+  CHIP8_OP_0NNN, CHIP8_OP_00E0, CHIP8_OP_00EE, CHIP8_OP_1NNN, CHIP8_OP_2NNN,
+  CHIP8_OP_3XNN, CHIP8_OP_4XNN, CHIP8_OP_5XY0, CHIP8_OP_6XNN, CHIP8_OP_7XNN,
+  CHIP8_OP_8XY0, CHIP8_OP_8XY1, CHIP8_OP_8XY2, CHIP8_OP_8XY3, CHIP8_OP_8XY4,
+  CHIP8_OP_8XY5, CHIP8_OP_8XY6, CHIP8_OP_8XY7, CHIP8_OP_8XYE, CHIP8_OP_9XY0,
+  CHIP8_OP_ANNN, CHIP8_OP_BNNN, CHIP8_OP_CXNN, CHIP8_OP_DXYN, CHIP8_OP_EX9E,
+  CHIP8_OP_EXA1, CHIP8_OP_FX07, CHIP8_OP_FX0A, CHIP8_OP_FX15, CHIP8_OP_FX18,
+  CHIP8_OP_FX1E, CHIP8_OP_FX29, CHIP8_OP_FX33, CHIP8_OP_FX55, CHIP8_OP_FX65,
+  // SUPER-CHIP
+  CHIP8_OP_00CN, CHIP8_OP_00FB, CHIP8_OP_00FC, CHIP8_OP_00FD, CHIP8_OP_00FE,
+  CHIP8_OP_00FF, CHIP8_OP_FX30, CHIP8_OP_FX75, CHIP8_OP_FX85,
+  // XO-CHIP
+  CHIP8_OP_00DN, CHIP8_OP_5XY2, CHIP8_OP_5XY3, CHIP8_OP_F000, CHIP8_OP_FN01,
+  CHIP8_OP_NOP, CHIP8_OP_INVALID,
+  CHIP8_OP_COUNT
+} CHIP8_op_t;
+
+// CHIP8 instruction
+typedef struct {
+  uint16_t opcode;
+  uint16_t NNN; // address/constant
+  uint8_t NN;   // 8 bit constant
+  uint8_t N;    // 4 bit constant
+  uint8_t X;    // register
+  uint8_t Y;    // register
+} CHIP8_instruction_t;
+
+// Predecoded instruction cache, one entry per 2 bytes of main memory
+#define CHIP8_DECODE_CACHE_SIZE 0x800
+
+typedef struct {
+  CHIP8_instruction_t instruction; // operand fields
+  uint32_t tag;                    // (generation << 16) | PC of the cached instruction, 0 when empty
+  uint8_t op;                      // CHIP8_op_t, index into the handler table
+} CHIP8_decoded_t;
+
+typedef struct CHIP8_s CHIP8_t;
+typedef void (*CHIP8_handler_t)(CHIP8_t *chip8_i);
+
+// The emulated machine only, no window/renderer/input handling lives here so the core can run headless
+struct CHIP8_s {
+  uint32_t clock_rate;
+  e_state_t run_state;
+  CHIP8_fault_t fault; // set together with run_state = QUIT when the program did something impossible
+  uint16_t fault_pc;   // address of the faulting instruction
+  CHIP8_engine_t engine;
+  CHIP8_quirks_t quirks;
+  const CHIP8_handler_t *handlers; // handler table of the quirk profile, set by CHIP8_set_quirks
+  uint16_t mem_mask;  // addressable memory - 1, 4K for CHIP-8 and SUPER-CHIP, 64K for XO-CHIP
+  char *rom;          // name of currently running program, argv[1]
+  uint64_t cycles;    // instructions executed since CHIP8_init
+  uint64_t skipped;   // of those, the ones idle loops fast-forwarded instead of executing, see CHIP8_idle
+  uint64_t frames;    // 60 Hz frames emulated since CHIP8_init, input recordings are keyed on this
+  uint64_t seed;      // seed the RNG was started from
+  // machine state, everything from V to MM is plain data and is saved/restored as one block, see CHIP8_STATE_SIZE
+  uint8_t V[0x10];    // 16 general purpose registers
+  uint16_t PC;        // program counter
+  uint16_t I;         // index register
+  uint8_t S;          // sound timer
+  uint8_t D;          // delay timer
+  uint8_t cycle_frac; // sixtieths of an instruction carried into the next frame, clock rates needn't divide by 60
+  bool hires;         // 128x64 SUPER-CHIP mode, otherwise only the top left 64x32 of display is used
+  uint8_t planes;     // bitmask of the planes drawn, cleared and scrolled, XO-CHIP FN01
+  // display, one bit per pixel per plane, bit 63 of a row's first word is x = 0 and its second word holds x = 64-127
+  uint64_t display[CHIP8_PLANES][DISPLAY_MAX_HEIGHT][DISPLAY_WORDS];
+  uint16_t stack[CHIP8_STACK_SIZE]; // The stack, mapped to RAM, for 12 levels of call nesting according to PG36 COSMAC VIP manual
+  uint8_t SP;
+  bool keypad[0x10];  // inputs 0-F
+  uint8_t flags[0x10]; // SUPER-CHIP RPL user flags, FX75/FX85
+  uint64_t rng;       // xorshift64* state for CXNN, per instance so runs are independent and reproducible
+  uint8_t MM[CHIP8_MEMORY_SIZE]; // main memory, addressed through mem_mask, only MM[0..mem_mask] is live
+  // end of machine state
+  CHIP8_instruction_t instruction; // current instruction
+  uint64_t budget;    // instructions left in the running CHIP8_run, idle loops skip what they can of it, 0 outside one
+  bool idle_skip;     // fast-forward idle loops instead of executing them, the result is the same either way
+  uint16_t decode_gen; // bumping this empties decode_cache in O(1)
+  CHIP8_decoded_t decode_cache[CHIP8_DECODE_CACHE_SIZE];
+  struct CHIP8_blocks_s *blocks; // translated blocks of the threaded engine, allocated on first use
+  struct CHIP8_trace_s *trace; // execution tracer, see trace.h, NULL when not tracing
+  struct CHIP8_audio_s *audio; // beeper sink, told whether S > 0 after every timer tick, NULL for none
+#ifdef CHIP8_STATS
+  struct CHIP8_stats_s *stats; // instruction counters and frame timings, see stats.h
+#endif
+  bool dirty;         // display changed since the frontend last presented it, the renderer finds what changed itself
+};
+
+// every address is masked with the uint16_t mem_mask before it reaches MM, so no ROM can index past it
+_Static_assert(CHIP8_MEMORY_SIZE == 0x10000, "MM must cover every uint16_t address");
+
+// the machine state block, from V up to and including MM
+#define CHIP8_STATE_START offsetof(CHIP8_t, V)
+#define CHIP8_STATE_MM_OFFSET (offsetof(CHIP8_t, MM) - CHIP8_STATE_START)
+#define CHIP8_STATE_SIZE (offsetof(CHIP8_t, MM) + sizeof(((CHIP8_t *)0)->MM) - CHIP8_STATE_START)
+// the part of the block in use: memory past mem_mask can't be reached, so it is never copied, compared or hashed
+#define CHIP8_STATE_USED(chip8_i) (CHIP8_STATE_MM_OFFSET + (size_t)(chip8_i)->mem_mask + 1)
+
+// instructions the next CHIP8_emulate_frame will run, clock_rate/60 rounded up or down so the average is exact
+static inline uint32_t CHIP8_frame_length(const CHIP8_t *chip8_i) {
+  return (chip8_i->clock_rate + chip8_i->cycle_frac) / 60;
+}
+
+// size of the display in the current resolution
+static inline int CHIP8_display_width(const CHIP8_t *chip8_i) {
+  return chip8_i->hires ? DISPLAY_MAX_WIDTH : DISPLAY_WIDTH;
+}
+
+static inline int CHIP8_display_height(const CHIP8_t *chip8_i) {
+  return chip8_i->hires ? DISPLAY_MAX_HEIGHT : DISPLAY_HEIGHT;
+}
+
+// colour of one pixel of the packed display, bit n is set when plane n is
+static inline uint8_t CHIP8_pixel(const CHIP8_t *chip8_i, int x, int y) {
+  uint8_t colour = 0;
+  for (int p = 0; p < CHIP8_PLANES; p++) {
+    colour |= ((chip8_i->display[p][y][x >> 6] >> (63 - (x & 63))) & 1) << p;
+  }
+  return colour;
+}
+
+// the display changed, the frontend publishes it at the end of the frame
+static inline void CHIP8_mark_dirty(CHIP8_t *chip8_i) {
+  chip8_i->dirty = true;
+}
+
+// xorshift64*, top byte of the scrambled output
+static inline uint8_t CHIP8_rand(CHIP8_t *chip8_i) {
+  uint64_t x = chip8_i->rng;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  chip8_i->rng = x;
+  return (x * 0x2545F4914F6CDD1Dull) >> 56;
+}
+
+extern const char *const CHIP8_engine_names[CHIP8_ENGINE_COUNT];
+extern const char *const CHIP8_op_names[CHIP8_OP_COUNT];
+extern const char *const CHIP8_quirks_names[CHIP8_QUIRKS_COUNT];
+extern const char *const CHIP8_fault_names[CHIP8_FAULT_COUNT];
+extern const bool CHIP8_quirk_jump_vx[CHIP8_QUIRKS_COUNT];
+extern const CHIP8_handler_t *const CHIP8_quirk_handlers[CHIP8_QUIRKS_COUNT];
+extern uint8_t CHIP8_optable[0x10000];
+
+CHIP8_t* CHIP8_create(uint32_t clock_rate);
+void CHIP8_destroy(CHIP8_t *chip8_i);
+int CHIP8_init(CHIP8_t *chip8_i, char *rom_name);
+int CHIP8_load(CHIP8_t *chip8_i, char *rom_name, const uint8_t *rom, size_t size);
+int CHIP8_stop(CHIP8_t *chip8_i);
+void CHIP8_seed(CHIP8_t *chip8_i, uint64_t seed);
+
+int CHIP8_engine_from_name(const char *name, CHIP8_engine_t *engine);
+int CHIP8_quirks_from_name(const char *name, CHIP8_quirks_t *quirks);
+void CHIP8_set_quirks(CHIP8_t *chip8_i, CHIP8_quirks_t quirks);
+CHIP8_op_t CHIP8_decode_op(uint16_t opcode);
+void CHIP8_build_dispatch(void);
+
+void CHIP8_invalidate(CHIP8_t *chip8_i, uint16_t addr, uint16_t len);
+void CHIP8_write_memory(CHIP8_t *chip8_i, const uint8_t *MM, uint32_t size);
+void CHIP8_flush_caches(CHIP8_t *chip8_i);
+
+void CHIP8_emulate_instruction(CHIP8_t *chip8_i);
+void CHIP8_run(CHIP8_t *chip8_i, uint64_t n);
+void CHIP8_tick_timers(CHIP8_t *chip8_i);
+void CHIP8_emulate_frame(CHIP8_t *chip8_i);
+void CHIP8_run_headless(CHIP8_t *chip8_i, uint64_t cycles);
+
+uint64_t CHIP8_state_hash(const CHIP8_t *chip8_i);
+void CHIP8_dump_state(const CHIP8_t *chip8_i, FILE *out);
+
+#endif
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "state.h"
+#include "conform.h"
+
+uint64_t CHIP8_display_hash(const CHIP8_t *chip8_i) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  const uint64_t *words = &chip8_i->display[0][0][0];
+  for (size_t i = 0; i < sizeof(chip8_i->display) / sizeof(uint64_t); i++) {
+    // a byte at a time, low byte first, so the hash doesn't depend on the host's byte order
+    for (int b = 0; b < 64; b += 8) {
+      hash = (hash ^ ((words[i] >> b) & 0xFF)) * 0x100000001B3ull;
+    }
+  }
+  hash = (hash ^ chip8_i->hires) * 0x100000001B3ull;
+  return hash;
+}
+
+// A fresh instance with the ROM loaded and seed 0, as every conformance run starts. Lockstep runs turn
+// idle_skip off so every instruction of an idle loop is executed and compared rather than fast-forwarded
+static CHIP8_t *CHIP8_conform_create(char *rom, CHIP8_quirks_t quirks, uint32_t clock_rate, CHIP8_engine_t engine, bool idle_skip) {
+  CHIP8_t *chip8_i = CHIP8_create(clock_rate);
+  if (chip8_i == NULL) {
+    return NULL;
+  }
+  chip8_i->engine = engine;
+  chip8_i->idle_skip = idle_skip;
+  CHIP8_set_quirks(chip8_i, quirks);
+  CHIP8_seed(chip8_i, 0);
+  if (CHIP8_init(chip8_i, rom)) {
+    CHIP8_destroy(chip8_i);
+    return NULL;
+  }
+  return chip8_i;
+}
+
+// Describe the first difference between the machines in what, false if there is none
+static bool CHIP8_conform_diff(const CHIP8_t *a, const CHIP8_t *b, char *what, size_t size) {
+  #define DIFF(x, y, ...) if ((x) != (y)) { \
+      const int n = snprintf(what, size, __VA_ARGS__); \
+      snprintf(what + n, size - n, " 0x%llX != 0x%llX", (unsigned long long)(x), (unsigned long long)(y)); \
+      return true; \
+    }
+  DIFF(a->fault, b->fault, "fault");
+  DIFF(a->cycles, b->cycles, "cycles");
+  DIFF(a->PC, b->PC, "PC");
+  DIFF(a->I, b->I, "I");
+  for (int i = 0; i < 0x10; i++) DIFF(a->V[i], b->V[i], "V%X", i);
+  DIFF(a->SP, b->SP, "SP");
+  for (int i = 0; i < CHIP8_STACK_SIZE; i++) DIFF(a->stack[i], b->stack[i], "stack[%d]", i);
+  DIFF(a->D, b->D, "D");
+  DIFF(a->S, b->S, "S");
+  DIFF(a->cycle_frac, b->cycle_frac, "cycle_frac");
+  DIFF(a->hires, b->hires, "hires");
+  DIFF(a->planes, b->planes, "planes");
+  for (int i = 0; i < 0x10; i++) DIFF(a->flags[i], b->flags[i], "flags[%d]", i);
+  DIFF(a->rng, b->rng, "rng");
+  // both run the same profile, only the memory it reaches can differ
+  if (memcmp(a->MM, b->MM, (size_t)a->mem_mask + 1)) {
+    for (int i = 0; i <= a->mem_mask; i++) DIFF(a->MM[i], b->MM[i], "MM[0x%04X]", i);
+  }
+  for (int p = 0; p < CHIP8_PLANES; p++) {
+    for (int y = 0; y < DISPLAY_MAX_HEIGHT; y++) {
+      for (int w = 0; w < DISPLAY_WORDS; w++) DIFF(a->display[p][y][w], b->display[p][y][w], "display[%d][%d][%d]", p, y, w);
+    }
+  }
+  #undef DIFF
+  return false;
+}
+
+int CHIP8_lockstep(char *rom, CHIP8_quirks_t quirks, uint32_t clock_rate, CHIP8_engine_t reference, CHIP8_engine_t engine, uint64_t cycles, CHIP8_divergence_t *divergence) {
+  CHIP8_t *a = CHIP8_conform_create(rom, quirks, clock_rate, reference, false);
+  CHIP8_t *b = CHIP8_conform_create(rom, quirks, clock_rate, engine, false);
+  CHIP8_snapshot_t *start = malloc(2 * sizeof(CHIP8_snapshot_t));
+  if (a == NULL || b == NULL || start == NULL) {
+    if (a) CHIP8_destroy(a);
+    if (b) CHIP8_destroy(b);
+    free(start);
+    return -1;
+  }
+
+  // whole frames while they agree, a frame of the threaded engine runs its blocks like a real run would
+  int ret = 0;
+  a->run_state = b->run_state = RUNNING;
+  while (a->cycles < cycles && a->run_state == RUNNING && b->run_state == RUNNING) {
+    CHIP8_snapshot_take(a, &start[0]);
+    CHIP8_snapshot_take(b, &start[1]);
+    CHIP8_emulate_frame(a);
+    CHIP8_emulate_frame(b);
+    if (!CHIP8_conform_diff(a, b, divergence->what, sizeof(divergence->what))) continue;
+
+    // replay the frame from its start with one more instruction each time until the difference shows,
+    // if it never does the timer update at the end of the frame is what differs
+    ret = 1;
+    const uint64_t len = (a->cycles > b->cycles ? a->cycles : b->cycles) - start[0].cycles;
+    CHIP8_snapshot_restore(a, &start[0]);
+    for (uint64_t k = 1; k <= len; k++) {
+      divergence->cycle = a->cycles;
+      divergence->pc = a->PC;
+      divergence->opcode = (a->MM[a->PC & a->mem_mask] << 8) | a->MM[(a->PC + 1) & a->mem_mask];
+      CHIP8_snapshot_restore(a, &start[0]);
+      CHIP8_snapshot_restore(b, &start[1]);
+      a->run_state = b->run_state = RUNNING;
+      CHIP8_run(a, k);
+      CHIP8_run(b, k);
+      if (CHIP8_conform_diff(a, b, divergence->what, sizeof(divergence->what))) break;
+    }
+    if (!CHIP8_conform_diff(a, b, divergence->what, sizeof(divergence->what))) {
+      CHIP8_snapshot_restore(a, &start[0]);
+      CHIP8_snapshot_restore(b, &start[1]);
+      CHIP8_emulate_frame(a);
+      CHIP8_emulate_frame(b);
+      CHIP8_conform_diff(a, b, divergence->what, sizeof(divergence->what));
+      divergence->cycle = a->cycles;
+      divergence->pc = a->PC;
+      divergence->opcode = 0;
+    }
+    break;
+  }
+
+  CHIP8_destroy(a);
+  CHIP8_destroy(b);
+  free(start);
+  return ret;
+}
+
+// Every engine must reach the golden display, and all but the reference must stay in lockstep with it
+static bool CHIP8_conform_case(char *rom, uint64_t cycles, CHIP8_quirks_t quirks, uint32_t clock_rate, bool has_expected, uint64_t expected, FILE *out) {
+  bool ok = true;
+  for (int e = 0; e < CHIP8_ENGINE_COUNT; e++) {
+    CHIP8_t *chip8_i = CHIP8_conform_create(rom, quirks, clock_rate, (CHIP8_engine_t)e, true);
+    if (chip8_i == NULL) {
+      fprintf(out, "FAIL %s %s: could not load\n", rom, CHIP8_quirks_names[quirks]);
+      return false;
+    }
+    CHIP8_run_headless(chip8_i, cycles);
+    const uint64_t hash = CHIP8_display_hash(chip8_i);
+    CHIP8_destroy(chip8_i);
+    if (!has_expected) {
+      // nothing to compare against yet, the reference engine's hash is the one to paste in
+      if (e == CHIP8_ENGINE_SWITCH) {
+        fprintf(out, "NEW  %s %llu %s 0x%016llX", rom, (unsigned long long)cycles, CHIP8_quirks_names[quirks], (unsigned long long)hash);
+        fprintf(out, clock_rate ? " %u\n" : "\n", clock_rate);
+      }
+      ok = false;
+    } else if (hash != expected) {
+      fprintf(out, "FAIL %s %s: %s display 0x%016llX, expected 0x%016llX\n", rom, CHIP8_quirks_names[quirks], CHIP8_engine_names[e], (unsigned long long)hash, (unsigned long long)expected);
+      ok = false;
+    }
+  }
+  for (int e = 0; e < CHIP8_ENGINE_COUNT; e++) {
+    if (e == CHIP8_ENGINE_SWITCH) continue;
+    CHIP8_divergence_t divergence;
+    const int ret = CHIP8_lockstep(rom, quirks, clock_rate, CHIP8_ENGINE_SWITCH, (CHIP8_engine_t)e, cycles, &divergence);
+    if (ret > 0) {
+      fprintf(out, "FAIL %s %s: %s diverges from switch at cycle %llu, PC 0x%04X (0x%04X): %s\n",
+        rom, CHIP8_quirks_names[quirks], CHIP8_engine_names[e], (unsigned long long)divergence.cycle, divergence.pc, divergence.opcode, divergence.what);
+    } else if (ret < 0) {
+      fprintf(out, "FAIL %s %s: could not run %s in lockstep\n", rom, CHIP8_quirks_names[quirks], CHIP8_engine_names[e]);
+    }
+    if (ret) ok = false;
+  }
+  if (ok) fprintf(out, "ok   %s %s\n", rom, CHIP8_quirks_names[quirks]);
+  return ok;
+}
+
+int CHIP8_conformance_run(const char *path, FILE *out) {
+  FILE *cases = fopen(path, "r");
+  if (!cases) {
+    fprintf(stderr, "Could not open conformance cases %s\n", path);
+    return -1;
+  }
+  int total = 0, failed = 0;
+  char line[1024];
+  int lineno = 0;
+  while (fgets(line, sizeof(line), cases)) {
+    lineno++;
+    char *fields[5] = { NULL };
+    int nfields = 0;
+    for (char *tok = strtok(line, " \t\r\n"); tok && nfields < 5; tok = strtok(NULL, " \t\r\n")) {
+      if (tok[0] == '#') break;
+      fields[nfields++] = tok;
+    }
+    if (!nfields) continue;
+    CHIP8_quirks_t quirks;
+    if (nfields < 3 || CHIP8_quirks_from_name(fields[2], &quirks)) {
+      fprintf(stderr, "%s:%d: expected rom cycles quirks [display-hash [clock-rate]]\n", path, lineno);
+      failed++;
+      continue;
+    }
+    total++;
+    const uint64_t cycles = strtoull(fields[1], NULL, 0);
+    const uint64_t expected = nfields > 3 ? strtoull(fields[3], NULL, 0) : 0;
+    const uint32_t clock_rate = nfields > 4 ? (uint32_t)strtoul(fields[4], NULL, 0) : 0;
+    if (!CHIP8_conform_case(fields[0], cycles, quirks, clock_rate, nfields > 3, expected, out)) failed++;
+  }
+  fclose(cases);
+  fprintf(out, "%d cases, %d failed\n", total, failed);
+  return failed ? 1 : 0;
+}
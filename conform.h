@@ -0,0 +1,31 @@
+#ifndef CONFORM_H
+#define CONFORM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+// Conformance suite: one case per line, "rom cycles quirks display-hash [clock-rate]", blank lines and # comments
+// ignored. The clock rate defaults to 700, a new case at another rate can start with a hash of 0.
+// Every engine runs each ROM headless from seed 0 and must end on the expected display hash, and every engine
+// is run in lockstep against the switch interpreter. A case with no hash yet prints the one it got.
+int CHIP8_conformance_run(const char *path, FILE *out);
+
+// Where two engines first disagreed
+typedef struct {
+  uint64_t cycle;  // instructions executed before the one that diverged
+  uint16_t pc;     // the instruction that diverged
+  uint16_t opcode;
+  char what[64];   // the first differing register or location, reference value first
+} CHIP8_divergence_t;
+
+// Run engine against reference frame by frame, on the first difference narrow it down to the instruction.
+// The threaded engine only runs a block whole, so for it the instruction found is the end of the block.
+// 0 if they agree for all cycles, 1 if they diverge and divergence says where, -1 if the ROM can't be run.
+int CHIP8_lockstep(char *rom, CHIP8_quirks_t quirks, uint32_t clock_rate, CHIP8_engine_t reference, CHIP8_engine_t engine, uint64_t cycles, CHIP8_divergence_t *divergence);
+
+// FNV-1a over the packed display words, both planes, and the resolution
+uint64_t CHIP8_display_hash(const CHIP8_t *chip8_i);
+
+#endif
@@ -0,0 +1,458 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <SDL.h>
+
+#include "chip8.h"
+#include "frontend.h"
+#include "state.h"
+#include "sched.h"
+#include "stats.h"
+#include "trace.h"
+
+// the last part of a frame wait is spun rather than slept
+#define CHIP8_SPIN_NS 2000000
+
+// XO-CHIP colours for pixels set in plane 2 only and in both planes
+#define CHIP8_PLANE2_COLOR 0xFF6600FF
+#define CHIP8_BLEND_COLOR 0x662200FF
+
+const rgba_t rgba_default = { 0x00, 0x00, 0x00, 0xFF };
+
+// SDL's performance counter in nanoseconds, split to avoid overflowing the multiply
+static uint64_t CHIP8_now_ns(void) {
+  const uint64_t counter = SDL_GetPerformanceCounter();
+  const uint64_t freq = SDL_GetPerformanceFrequency();
+  return counter / freq * 1000000000ull + counter % freq * 1000000000ull / freq;
+}
+
+// SDL_Delay can oversleep by a whole OS tick, so sleep until close to the deadline and spin the rest
+static void CHIP8_sleep_until(uint64_t deadline_ns) {
+  for (;;) {
+    const uint64_t now = CHIP8_now_ns();
+    if (now >= deadline_ns) return;
+    const uint64_t left = deadline_ns - now;
+    if (left > CHIP8_SPIN_NS) SDL_Delay((left - CHIP8_SPIN_NS) / 1000000);
+  }
+}
+
+CHIP8_frontend_t* CHIP8_frontend_create(CHIP8_t *chip8_i, uint8_t scale_factor, uint32_t bg_color, uint32_t fg_color) {
+  CHIP8_frontend_t *frontend = malloc(sizeof(CHIP8_frontend_t));
+  if (frontend == NULL) {
+    SDL_Log("Could not allocate frontend\n");
+    return NULL;
+  }
+  frontend->window_w = DISPLAY_WIDTH;
+  frontend->window_h = DISPLAY_HEIGHT;
+  frontend->window_scale = 20;
+  frontend->bg_color = rgba_default;
+  frontend->fg_color = rgba_default;
+  frontend->last_event = NULL;
+  frontend->redraw = true;
+  frontend->state_path = "chip8.state";
+  frontend->rewind = NULL;
+  frontend->recorder = NULL;
+  frontend->beeper = NULL;
+  frontend->uploaded = false;
+  atomic_init(&frontend->rewinding, false);
+  atomic_init(&frontend->keys, 0);
+  atomic_init(&frontend->keys_ns, 0);
+  atomic_init(&frontend->commands, 0);
+  atomic_init(&frontend->running, false);
+  frontend->latency_ns = 0;
+  frontend->latency_max_ns = 0;
+  frontend->latency_count = 0;
+  frontend->run_ahead = 0;
+  frontend->work_ns = 0;
+  frontend->work_max_ns = 0;
+  frontend->work_count = 0;
+  CHIP8_triple_init(&frontend->handoff);
+  frontend->chip8_i = chip8_i;
+  if (scale_factor) frontend->window_scale = scale_factor;
+  if (bg_color) {
+    frontend->bg_color.r = (bg_color >> 24) & 0xFF; // shift right 24 and take the byte because of x86 endianness
+    frontend->bg_color.g = (bg_color >> 16) & 0xFF; // since x86 is little endian, r is the MSB stored at highest address of the uint32 word
+    frontend->bg_color.b = (bg_color >> 8) & 0xFF;
+    frontend->bg_color.a = (bg_color >> 0) & 0xFF; // for OCD's sake :)
+  }
+  if (fg_color) {
+    frontend->fg_color.r = (fg_color >> 24) & 0xFF; // shift right 24 and take the byte because of x86 endianness
+    frontend->fg_color.g = (fg_color >> 16) & 0xFF; // since x86 is little endian, r is the MSB stored at highest address of the uint32 word
+    frontend->fg_color.b = (fg_color >> 8) & 0xFF;
+    frontend->fg_color.a = (fg_color >> 0) & 0xFF; // for OCD's sake :)
+  }
+  frontend->Window = SDL_CreateWindow(
+    "Dev's CHIP8 Emulator Instance",
+    SDL_WINDOWPOS_UNDEFINED,
+    SDL_WINDOWPOS_UNDEFINED,
+    frontend->window_w*frontend->window_scale,
+    frontend->window_h*frontend->window_scale,
+    0
+  );
+
+  if (frontend->Window == NULL) {
+    SDL_Log("SDL could not create window: %s\n", SDL_GetError());
+    free(frontend);
+    return NULL;
+  }
+
+  frontend->Renderer = SDL_CreateRenderer(frontend->Window, -1, SDL_RENDERER_ACCELERATED);
+  if (!frontend->Renderer) {
+    SDL_Log("SDL could not create SDL renderer: %s\n", SDL_GetError());
+    SDL_DestroyWindow(frontend->Window);
+    free(frontend);
+    return NULL;
+  }
+
+  // the framebuffer is expanded into a display sized texture once per frame and scaled up by SDL_RenderCopy
+  frontend->Texture = SDL_CreateTexture(frontend->Renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, DISPLAY_MAX_WIDTH, DISPLAY_MAX_HEIGHT);
+  if (!frontend->Texture) {
+    SDL_Log("SDL could not create SDL texture: %s\n", SDL_GetError());
+    SDL_DestroyRenderer(frontend->Renderer);
+    SDL_DestroyWindow(frontend->Window);
+    free(frontend);
+    return NULL;
+  }
+  // overwrite like SDL_RenderFillRect did instead of alpha blending
+  SDL_SetTextureBlendMode(frontend->Texture, SDL_BLENDMODE_NONE);
+  // RGBA8888 is r in the most significant byte, same layout as the colour arguments
+  frontend->palette[0] = ((uint32_t)frontend->bg_color.r << 24) | ((uint32_t)frontend->bg_color.g << 16) | ((uint32_t)frontend->bg_color.b << 8) | frontend->bg_color.a;
+  frontend->palette[1] = ((uint32_t)frontend->fg_color.r << 24) | ((uint32_t)frontend->fg_color.g << 16) | ((uint32_t)frontend->fg_color.b << 8) | frontend->fg_color.a;
+  frontend->palette[2] = CHIP8_PLANE2_COLOR;
+  frontend->palette[3] = CHIP8_BLEND_COLOR;
+
+  SDL_SetRenderDrawColor(frontend->Renderer, frontend->bg_color.r, frontend->bg_color.g, frontend->bg_color.b, frontend->bg_color.a);
+  SDL_RenderClear(frontend->Renderer);
+  SDL_RenderPresent(frontend->Renderer);
+  return frontend;
+}
+
+void CHIP8_frontend_destroy(CHIP8_frontend_t *frontend) {
+  CHIP8_rewind_destroy(frontend->rewind);
+  if (frontend->beeper) {
+    frontend->chip8_i->audio = NULL;
+    CHIP8_beeper_destroy(frontend->beeper);
+  }
+  SDL_DestroyTexture(frontend->Texture);
+  SDL_DestroyRenderer(frontend->Renderer);
+  SDL_DestroyWindow(frontend->Window);
+  free(frontend);
+}
+
+void CHIP8_start(CHIP8_frontend_t *frontend) {
+  frontend->chip8_i->run_state = RUNNING;
+  CHIP8_main_loop(frontend);
+}
+
+// keypad keyboard
+// 123C   1234 
+// 456D   qwer
+// 789E   asdf
+// A0BF   zxcv
+
+// keypad index for a keyboard key, -1 if it isn't mapped
+static int CHIP8_key_index(SDL_Keycode key) {
+  switch (key) {
+    case SDLK_1: return 0x1;
+    case SDLK_2: return 0x2;
+    case SDLK_3: return 0x3;
+    case SDLK_4: return 0xC;
+    case SDLK_q: return 0x4;
+    case SDLK_w: return 0x5;
+    case SDLK_e: return 0x6;
+    case SDLK_r: return 0xD;
+    case SDLK_a: return 0x7;
+    case SDLK_s: return 0x8;
+    case SDLK_d: return 0x9;
+    case SDLK_f: return 0xE;
+    case SDLK_z: return 0xA;
+    case SDLK_x: return 0x0;
+    case SDLK_c: return 0xB;
+    case SDLK_v: return 0xF;
+    default: return -1;
+  }
+}
+
+static void CHIP8_set_key(CHIP8_frontend_t *frontend, int key, bool down) {
+  if (key < 0) return;
+  const uint16_t bit = 1u << key;
+  const uint16_t keys = atomic_load_explicit(&frontend->keys, memory_order_relaxed);
+  if (!!(keys & bit) == down) return; // key repeat
+  atomic_store_explicit(&frontend->keys_ns, CHIP8_now_ns(), memory_order_relaxed);
+  atomic_store_explicit(&frontend->keys, down ? keys | bit : keys & ~bit, memory_order_release);
+}
+
+// Runs on the window thread, everything that touches the core is passed on as a command
+void CHIP8_handle_input(CHIP8_frontend_t *frontend) {
+  SDL_Event event;
+  // TODO need to get information from the event to see which instance this is, but won't make a difference for now
+  while (SDL_PollEvent(&event)) {
+    switch (event.type) {
+    // SDL_Quit fires when X is clicked in the windows toolbar for the program
+      case SDL_QUIT: 
+        atomic_fetch_or(&frontend->commands, CHIP8_CMD_QUIT);
+        break;
+      case SDL_KEYDOWN:
+        switch (event.key.keysym.sym) {
+          case SDLK_SPACE: atomic_fetch_or(&frontend->commands, CHIP8_CMD_PAUSE); break; // use as pause
+          case SDLK_F2: atomic_fetch_or(&frontend->commands, CHIP8_CMD_TRACE); break;
+          case SDLK_F5: atomic_fetch_or(&frontend->commands, CHIP8_CMD_SAVE); break;
+          case SDLK_F9: atomic_fetch_or(&frontend->commands, CHIP8_CMD_LOAD); break;
+          case SDLK_BACKSPACE: atomic_store(&frontend->rewinding, frontend->rewind != NULL); break;
+          default: CHIP8_set_key(frontend, CHIP8_key_index(event.key.keysym.sym), true); break;
+        }
+        break;
+      case SDL_KEYUP:
+        switch (event.key.keysym.sym) {
+          case SDLK_BACKSPACE: atomic_store(&frontend->rewinding, false); break;
+          default: CHIP8_set_key(frontend, CHIP8_key_index(event.key.keysym.sym), false); break;
+        }
+        break;
+      case SDL_WINDOWEVENT:
+        // the window contents were lost, present the texture again even if the display didn't change
+        if (event.window.event == SDL_WINDOWEVENT_EXPOSED || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+          frontend->redraw = true;
+        }
+        break;
+      default: break;
+    }
+  }
+}
+
+// Expand the part of the frame that differs from what the texture shows into the streaming texture and draw it scaled to the window
+void CHIP8_render(CHIP8_frontend_t *frontend, const CHIP8_frame_t *frame) {
+  const int w = frame->hires ? DISPLAY_MAX_WIDTH : DISPLAY_WIDTH;
+  const int h = frame->hires ? DISPLAY_MAX_HEIGHT : DISPLAY_HEIGHT;
+  const int words = frame->hires ? 2 : 1;
+  // a resolution change redraws everything
+  const bool all = !frontend->uploaded || frame->hires != frontend->shown_hires;
+  // the box around the changed pixels, from the rows that differ and the OR of their changed bits over all planes
+  int y0 = h, y1 = -1;
+  uint64_t columns[DISPLAY_WORDS] = { 0 };
+  for (int y = 0; y < h; y++) {
+    uint64_t row = 0;
+    for (int i = 0; i < words; i++) {
+      uint64_t changed = all ? ~0ull : 0;
+      for (int p = 0; p < CHIP8_PLANES; p++) {
+        changed |= frame->display[p][y][i] ^ frontend->shown[p][y][i];
+      }
+      columns[i] |= changed;
+      row |= changed;
+    }
+    if (row) {
+      if (y0 == h) y0 = y;
+      y1 = y;
+    }
+  }
+  if (y1 >= 0) {
+    const int x0 = columns[0] ? __builtin_clzll(columns[0]) : 64 + __builtin_clzll(columns[1]);
+    const int x1 = words == 2 && columns[1] ? DISPLAY_MAX_WIDTH - 1 - __builtin_ctzll(columns[1]) : 63 - __builtin_ctzll(columns[0]);
+    const SDL_Rect rect = { .x = x0, .y = y0, .w = x1 - x0 + 1, .h = y1 - y0 + 1 };
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(frontend->Texture, &rect, &pixels, &pitch)) {
+      SDL_Log("SDL could not lock texture: %s\n", SDL_GetError());
+      return;
+    }
+    for (int y = 0; y < rect.h; y++) {
+      uint32_t *line = (uint32_t *)pixels + y*(pitch / sizeof(uint32_t));
+      for (int x = 0; x < rect.w; x++) {
+        const int px = rect.x + x;
+        unsigned colour = 0;
+        for (int p = 0; p < CHIP8_PLANES; p++) {
+          colour |= ((frame->display[p][rect.y + y][px >> 6] >> (63 - (px & 63))) & 1) << p;
+        }
+        line[x] = frontend->palette[colour];
+      }
+    }
+    SDL_UnlockTexture(frontend->Texture);
+    memcpy(frontend->shown, frame->display, sizeof(frontend->shown));
+    frontend->shown_hires = frame->hires;
+    frontend->uploaded = true;
+  }
+  // low resolution only uses the top left of the texture
+  const SDL_Rect source = { .x = 0, .y = 0, .w = w, .h = h };
+  SDL_RenderCopy(frontend->Renderer, frontend->Texture, &source, NULL);
+
+  #ifdef DEBUG
+    // pixel grid
+    const int window_w = frontend->window_w * frontend->window_scale, window_h = frontend->window_h * frontend->window_scale;
+    SDL_SetRenderDrawColor(frontend->Renderer, 0x80, 0x80, 0x80, 0x80);
+    for (int x = 0; x <= w; x++) {
+      SDL_RenderDrawLine(frontend->Renderer, x*window_w/w, 0, x*window_w/w, window_h);
+    }
+    for (int y = 0; y <= h; y++) {
+      SDL_RenderDrawLine(frontend->Renderer, 0, y*window_h/h, window_w, y*window_h/h);
+    }
+  #endif
+}
+
+// Commands from the window thread, applied between frames so they never race the core
+static void CHIP8_apply_commands(CHIP8_frontend_t *frontend) {
+  CHIP8_t *chip8_i = frontend->chip8_i;
+  const uint32_t commands = atomic_exchange(&frontend->commands, 0);
+  if (commands & CHIP8_CMD_QUIT) {
+    chip8_i->run_state = QUIT;
+    return;
+  }
+  if (commands & CHIP8_CMD_PAUSE) {
+    if (chip8_i->run_state == RUNNING) {
+      chip8_i->run_state = STOPPED; // pause
+      SDL_Log("<<<<< PAUSED >>>>>");
+    } else {
+      chip8_i->run_state = RUNNING; // resume
+      SDL_Log("<<<<< RESUME >>>>>");
+    }
+    // no beeping through a pause
+    if (chip8_i->audio) CHIP8_audio_update(chip8_i->audio, chip8_i->frames, chip8_i->run_state == RUNNING && chip8_i->S > 0);
+  }
+  if ((commands & CHIP8_CMD_TRACE) && chip8_i->trace) {
+    const bool enabled = !atomic_load(&chip8_i->trace->enabled);
+    CHIP8_trace_enable(chip8_i->trace, enabled);
+    SDL_Log("Tracing %s", enabled ? "on" : "off");
+  }
+  if (commands & CHIP8_CMD_SAVE) {
+    if (!CHIP8_state_write(chip8_i, frontend->state_path, NULL)) {
+      SDL_Log("State saved to %s", frontend->state_path);
+    }
+  }
+  if (commands & CHIP8_CMD_LOAD) {
+    if (frontend->recorder) {
+      SDL_Log("Loading a state is disabled while recording input");
+    } else if (!CHIP8_state_read(chip8_i, frontend->state_path, NULL)) {
+      SDL_Log("State loaded from %s", frontend->state_path);
+      // the history leads up to the old state, not the loaded one
+      if (frontend->rewind) CHIP8_rewind_reset(frontend->rewind);
+    }
+  }
+}
+
+// Copy the keys the user holds into the keypad, timing how long the change took to get here
+static void CHIP8_apply_keys(CHIP8_frontend_t *frontend) {
+  CHIP8_t *chip8_i = frontend->chip8_i;
+  const uint16_t keys = atomic_load_explicit(&frontend->keys, memory_order_acquire);
+  bool changed = false;
+  for (int i = 0; i < 0x10; i++) {
+    const bool down = (keys >> i) & 1;
+    changed |= chip8_i->keypad[i] != down;
+    chip8_i->keypad[i] = down;
+  }
+  if (changed) {
+    const uint64_t now = CHIP8_now_ns();
+    const uint64_t since = atomic_load_explicit(&frontend->keys_ns, memory_order_relaxed);
+    const uint64_t latency = now > since ? now - since : 0;
+    frontend->latency_ns += latency;
+    if (latency > frontend->latency_max_ns) frontend->latency_max_ns = latency;
+    frontend->latency_count++;
+  }
+}
+
+// Emulation thread: paces and runs frames and publishes every changed display, never waits on the window
+static int CHIP8_emulation_thread(void *data) {
+  CHIP8_frontend_t *frontend = data;
+  CHIP8_t *chip8_i = frontend->chip8_i;
+  CHIP8_sched_t sched;
+  CHIP8_sched_start(&sched, CHIP8_now_ns());
+  while (chip8_i->run_state != QUIT) {
+    CHIP8_apply_commands(frontend);
+    if (chip8_i->run_state == QUIT) break;
+    if (chip8_i->run_state == STOPPED) {
+      CHIP8_sched_pause(&sched, CHIP8_now_ns());
+      SDL_Delay(10);
+      continue;
+    }
+    CHIP8_sched_resume(&sched, CHIP8_now_ns());
+
+    // each frame runs clock_rate/60 instructions and ticks the timers once, several after a stall
+    const uint32_t due = CHIP8_sched_due(&sched, CHIP8_now_ns());
+    const uint64_t emulate_start = CHIP8_now_ns();
+    for (uint32_t i = 0; i < due && chip8_i->run_state == RUNNING; i++) {
+      if (atomic_load_explicit(&frontend->rewinding, memory_order_relaxed)) {
+        // one recorded frame back per frame, holds still once the history runs out
+        CHIP8_rewind_step(frontend->rewind, chip8_i);
+      } else {
+        CHIP8_apply_keys(frontend);
+        if (frontend->recorder) CHIP8_record_frame(frontend->recorder, chip8_i);
+        CHIP8_emulate_frame(chip8_i);
+        if (frontend->rewind) CHIP8_rewind_record(frontend->rewind, chip8_i);
+      }
+    }
+
+    if (frontend->run_ahead && due && chip8_i->run_state == RUNNING && !atomic_load_explicit(&frontend->rewinding, memory_order_relaxed)) {
+      // show where the current keys lead a few frames from now, published every frame since the
+      // prediction can change while the present display doesn't
+      CHIP8_frame_t *frame = CHIP8_triple_back(&frontend->handoff);
+      CHIP8_run_ahead(chip8_i, &frontend->ahead, frontend->run_ahead, frame->display, &frame->hires);
+      frame->frame = chip8_i->frames + frontend->run_ahead;
+      CHIP8_triple_publish(&frontend->handoff);
+      chip8_i->dirty = false;
+    } else if (chip8_i->dirty) {
+      // clean frames have nothing new to show, don't publish them at all
+      CHIP8_frame_t *frame = CHIP8_triple_back(&frontend->handoff);
+      memcpy(frame->display, chip8_i->display, sizeof(frame->display));
+      frame->hires = chip8_i->hires;
+      frame->frame = chip8_i->frames;
+      CHIP8_triple_publish(&frontend->handoff);
+      chip8_i->dirty = false;
+    }
+
+    const uint64_t sleep_start = CHIP8_now_ns();
+    if (due) {
+      const uint64_t work = sleep_start - emulate_start;
+      CHIP8_STAT_TIME(chip8_i, CHIP8_PHASE_EMULATE, work);
+      frontend->work_ns += work;
+      if (work > frontend->work_max_ns) frontend->work_max_ns = work;
+      frontend->work_count++;
+    }
+    CHIP8_sleep_until(CHIP8_sched_next(&sched));
+    CHIP8_STAT_TIME(chip8_i, CHIP8_PHASE_SLEEP, CHIP8_now_ns() - sleep_start);
+  }
+  CHIP8_sched_report(&sched, chip8_i->clock_rate, stdout);
+  printf("input latency avg %.3f ms, max %.3f ms over %llu key changes\n",
+    frontend->latency_count ? frontend->latency_ns / 1e6 / frontend->latency_count : 0.0,
+    frontend->latency_max_ns / 1e6,
+    (unsigned long long)frontend->latency_count);
+  if (frontend->run_ahead && frontend->work_count) {
+    // headroom: how much of a 60 Hz frame the emulation thread had left after its frames and the prediction
+    const double frame_ms = 1000.0 / CHIP8_SCHED_HZ;
+    const double avg_ms = frontend->work_ns / 1e6 / frontend->work_count;
+    const double max_ms = frontend->work_max_ns / 1e6;
+    printf("run-ahead %u frames: avg %.3f ms, max %.3f ms per frame, %.2f%% of the %.3f ms frame left (%.2f%% at worst)\n",
+      frontend->run_ahead, avg_ms, max_ms, 100 * (1 - avg_ms / frame_ms), frame_ms, 100 * (1 - max_ms / frame_ms));
+  }
+  atomic_store(&frontend->running, false);
+  return 0;
+}
+
+// Window thread: input and presentation, a present blocking on vsync doesn't slow the emulation down
+void CHIP8_main_loop(CHIP8_frontend_t *frontend) {
+  atomic_store(&frontend->running, true);
+  SDL_Thread *thread = SDL_CreateThread(CHIP8_emulation_thread, "chip8", frontend);
+  if (thread == NULL) {
+    SDL_Log("SDL could not create emulation thread: %s\n", SDL_GetError());
+    atomic_store(&frontend->running, false);
+    return;
+  }
+  while (atomic_load(&frontend->running)) {
+    CHIP8_handle_input(frontend);
+
+    bool fresh;
+    const CHIP8_frame_t *frame = CHIP8_triple_front(&frontend->handoff, &fresh);
+    if (fresh || frontend->redraw) {
+      #ifdef CHIP8_STATS
+        const uint64_t render_start = CHIP8_now_ns();
+      #endif
+      CHIP8_render(frontend, frame);
+      SDL_RenderPresent(frontend->Renderer);
+      CHIP8_STAT_TIME(frontend->chip8_i, CHIP8_PHASE_RENDER, CHIP8_now_ns() - render_start);
+      frontend->redraw = false;
+    } else {
+      SDL_Delay(1);
+    }
+  }
+  SDL_WaitThread(thread, NULL);
+}
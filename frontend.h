@@ -0,0 +1,76 @@
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+#include <stdatomic.h>
+
+#include <SDL.h>
+
+#include "chip8.h"
+#include "state.h"
+#include "rewind.h"
+#include "input.h"
+#include "triple.h"
+#include "beeper.h"
+
+struct rgba_s {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  uint8_t a;
+};
+typedef struct rgba_s rgba_t;
+
+// requests from the input thread, applied by the emulation thread between frames
+#define CHIP8_CMD_QUIT  0x1
+#define CHIP8_CMD_PAUSE 0x2 // toggle
+#define CHIP8_CMD_SAVE  0x4
+#define CHIP8_CMD_LOAD  0x8
+#define CHIP8_CMD_TRACE 0x10 // toggle
+
+// SDL window, renderer and input state wrapped around one core instance.
+// The core runs on its own thread and only the atomics and the triple buffer are shared with the window thread.
+typedef struct {
+  uint16_t window_w;
+  uint16_t window_h;
+  uint8_t window_scale;
+  rgba_t bg_color;
+  rgba_t fg_color;
+  SDL_Window *Window;
+  SDL_Renderer *Renderer;
+  SDL_Texture *Texture;  // DISPLAY_MAX_WIDTH x DISPLAY_MAX_HEIGHT, low resolution only uses the top left quarter
+  uint32_t palette[1 << CHIP8_PLANES]; // texel per pixel colour, RGBA8888: background, foreground, then the XO-CHIP plane colours
+  bool redraw;           // present even if no new frame arrived, e.g. after the window was exposed
+  bool uploaded;         // the texture holds shown, only the rows/columns that differ need uploading
+  uint64_t shown[CHIP8_PLANES][DISPLAY_MAX_HEIGHT][DISPLAY_WORDS]; // display currently in the texture
+  bool shown_hires;
+  CHIP8_triple_t handoff; // finished frames, emulation thread -> window thread
+  SDL_Event *last_event;
+  const char *state_path; // F5 saves the machine state here, F9 loads it back
+  CHIP8_rewind_t *rewind; // per-frame history, NULL when rewinding is disabled
+  _Atomic bool rewinding; // backspace held, step back a frame per frame instead of emulating
+  _Atomic uint16_t keys;  // keypad bits as the user holds them, copied into keypad before each frame
+  _Atomic uint64_t keys_ns; // when keys last changed, for the input latency figures
+  _Atomic uint32_t commands; // CHIP8_CMD_* bits
+  _Atomic bool running;   // the emulation thread hasn't finished yet
+  uint64_t latency_ns;    // SDL key event to keypad visibility, total and worst, emulation thread only
+  uint64_t latency_max_ns;
+  uint64_t latency_count;
+  uint32_t run_ahead;      // frames predicted past the present and shown instead of it, 0 shows the present
+  CHIP8_snapshot_t ahead;  // where the present waits while the prediction runs
+  uint64_t work_ns;        // wall time of the frames run per wakeup, run-ahead included, total and worst
+  uint64_t work_max_ns;
+  uint64_t work_count;
+  CHIP8_recorder_t *recorder; // logs keypad changes per frame, NULL when not recording
+  CHIP8_beeper_t *beeper; // the core's audio sink, NULL when muted
+  CHIP8_t *chip8_i;
+} CHIP8_frontend_t;
+
+CHIP8_frontend_t* CHIP8_frontend_create(CHIP8_t *chip8_i, uint8_t scale_factor, uint32_t bg_color, uint32_t fg_color);
+void CHIP8_frontend_destroy(CHIP8_frontend_t *frontend);
+
+void CHIP8_start(CHIP8_frontend_t *frontend);
+void CHIP8_handle_input(CHIP8_frontend_t *frontend);
+void CHIP8_render(CHIP8_frontend_t *frontend, const CHIP8_frame_t *frame);
+void CHIP8_main_loop(CHIP8_frontend_t *frontend);
+
+#endif
@@ -0,0 +1,107 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "chip8.h"
+
+// Coverage guided fuzzing entry point for the core. An input is a config byte, two keypad bytes and the ROM:
+//   byte 0  bits 0-2 quirk profile (mod CHIP8_QUIRKS_COUNT), bits 3-4 engine
+//   byte 1-2 keys held down for the whole run, bit n = key n
+//   rest    the ROM, loaded at 0x200 exactly like CHIP8_init would
+// Hostile ROMs are expected to fault, that is the emulator working. What the fuzzer looks for are host crashes,
+// sanitizer reports and hangs, which is everything CHIP8_fault exists to prevent.
+//
+// libFuzzer: make fuzz && ./chip8-fuzz corpus/
+// AFL or replaying crash files: make fuzz-standalone (CC=afl-clang-fast for AFL) && ./chip8-fuzz-standalone file...
+
+#ifndef CHIP8_FUZZ_CYCLES
+  #define CHIP8_FUZZ_CYCLES 2000 // a few frames, enough for timers, keys and self modifying code to come into play
+#endif
+#define CHIP8_FUZZ_HEADER 3
+
+// the fresh instance every input starts from, and the one that runs it
+static CHIP8_t *template;
+static CHIP8_t *chip8_i;
+static uint64_t runs;
+static uint64_t faults[CHIP8_FAULT_COUNT];
+
+static int CHIP8_fuzz_setup(void) {
+  template = CHIP8_create(0);
+  chip8_i = CHIP8_create(0);
+  if (template == NULL || chip8_i == NULL) return -1;
+  memcpy(chip8_i, template, sizeof(CHIP8_t));
+  return 0;
+}
+
+// Reset to the template without touching the allocator: everything up to MM is copied, CHIP8_load
+// rewrites the addressable part of MM and bumps the cache generations. Translated blocks stay allocated.
+static void CHIP8_fuzz_reset(void) {
+  memcpy(chip8_i, template, offsetof(CHIP8_t, MM));
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size < CHIP8_FUZZ_HEADER) return 0;
+  if (chip8_i == NULL && CHIP8_fuzz_setup()) abort();
+  CHIP8_fuzz_reset();
+
+  chip8_i->engine = (CHIP8_engine_t)((data[0] >> 3) % CHIP8_ENGINE_COUNT);
+  CHIP8_set_quirks(chip8_i, (CHIP8_quirks_t)((data[0] & 0x7) % CHIP8_QUIRKS_COUNT));
+  const uint16_t keys = data[1] | (data[2] << 8);
+  for (int i = 0; i < 0x10; i++) chip8_i->keypad[i] = (keys >> i) & 1;
+  // too big for the profile is rejected like any other load, not a finding
+  if (CHIP8_load(chip8_i, "fuzz", data + CHIP8_FUZZ_HEADER, size - CHIP8_FUZZ_HEADER)) return 0;
+
+  CHIP8_run_headless(chip8_i, CHIP8_FUZZ_CYCLES);
+  runs++;
+  faults[chip8_i->fault]++;
+  return 0;
+}
+
+#ifdef CHIP8_FUZZ_MAIN
+static uint8_t input[1 << 17];
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Run every file named on the command line, or stdin once (AFL without persistent mode), and print how
+// the ROMs ended. Under afl-clang-fast stdin is run in persistent mode, many inputs per process.
+int main(int argc, char **argv) {
+  const uint64_t start = now_ns();
+  if (argc < 2) {
+#ifdef __AFL_LOOP
+    while (__AFL_LOOP(10000)) {
+      const size_t size = fread(input, 1, sizeof(input), stdin);
+      LLVMFuzzerTestOneInput(input, size);
+    }
+#else
+    const size_t size = fread(input, 1, sizeof(input), stdin);
+    LLVMFuzzerTestOneInput(input, size);
+#endif
+  }
+  for (int i = 1; i < argc; i++) {
+    FILE *file = fopen(argv[i], "rb");
+    if (!file) {
+      fprintf(stderr, "Could not open %s\n", argv[i]);
+      continue;
+    }
+    const size_t size = fread(input, 1, sizeof(input), file);
+    fclose(file);
+    LLVMFuzzerTestOneInput(input, size);
+  }
+  const double secs = (now_ns() - start) / 1e9;
+  printf("%llu runs in %.3f s, %.0f runs/s\n", (unsigned long long)runs, secs, secs > 0 ? runs / secs : 0.0);
+  for (int f = 0; f < CHIP8_FAULT_COUNT; f++) {
+    if (faults[f]) printf("  %-16s %llu\n", CHIP8_fault_names[f], (unsigned long long)faults[f]);
+  }
+  return 0;
+}
+#endif
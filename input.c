@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "input.h"
+
+// offset of the frame count in the header, filled in when the recording is closed
+#define CHIP8_INPUT_SHA1_AT (4 + 2 + 2 + 8 + 4)
+#define CHIP8_INPUT_FRAMES_AT (CHIP8_INPUT_SHA1_AT + CHIP8_SHA1_SIZE)
+#define CHIP8_INPUT_HEADER (CHIP8_INPUT_FRAMES_AT + 8)
+
+static void put_le(uint8_t *p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    p[i] = (v >> (8*i)) & 0xFF;
+  }
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) {
+    v |= (uint64_t)p[i] << (8*i);
+  }
+  return v;
+}
+
+static uint16_t keypad_bits(const CHIP8_t *chip8_i) {
+  uint16_t keys = 0;
+  for (int i = 0; i < 0x10; i++) keys |= chip8_i->keypad[i] << i;
+  return keys;
+}
+
+// Start recording the keypad of chip8_i, call after it has been seeded and before its first frame.
+// sha1 is the ROM's, a replay refuses to run the recording against any other ROM
+CHIP8_recorder_t* CHIP8_record_open(const char *path, const CHIP8_t *chip8_i, const uint8_t sha1[CHIP8_SHA1_SIZE]) {
+  CHIP8_recorder_t *recorder = malloc(sizeof(CHIP8_recorder_t));
+  if (recorder == NULL) {
+    fprintf(stderr, "Could not allocate input recorder\n");
+    return NULL;
+  }
+  recorder->file = fopen(path, "wb");
+  if (recorder->file == NULL) {
+    fprintf(stderr, "Could not open %s for recording\n", path);
+    free(recorder);
+    return NULL;
+  }
+  uint8_t header[CHIP8_INPUT_HEADER];
+  memcpy(header, CHIP8_INPUT_MAGIC, 4);
+  put_le(header + 4, CHIP8_INPUT_VERSION, 2);
+  put_le(header + 6, chip8_i->quirks, 2);
+  put_le(header + 8, chip8_i->seed, 8);
+  put_le(header + 16, chip8_i->clock_rate, 4);
+  memcpy(header + CHIP8_INPUT_SHA1_AT, sha1, CHIP8_SHA1_SIZE);
+  put_le(header + CHIP8_INPUT_FRAMES_AT, 0, 8);
+  if (fwrite(header, sizeof(header), 1, recorder->file) != 1) {
+    fprintf(stderr, "Could not write recording header to %s\n", path);
+    fclose(recorder->file);
+    free(recorder);
+    return NULL;
+  }
+  recorder->keys = 0;
+  recorder->last_frame = 0;
+  return recorder;
+}
+
+// Call right before each emulated frame, logs the keypad if it changed since the last frame
+void CHIP8_record_frame(CHIP8_recorder_t *recorder, const CHIP8_t *chip8_i) {
+  const uint16_t keys = keypad_bits(chip8_i);
+  if (keys == recorder->keys) return;
+
+  uint8_t event[12];
+  int n = 0;
+  uint64_t delta = chip8_i->frames - recorder->last_frame;
+  do {
+    event[n++] = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0);
+    delta >>= 7;
+  } while (delta);
+  put_le(event + n, keys, 2);
+  fwrite(event, n + 2, 1, recorder->file);
+  recorder->keys = keys;
+  recorder->last_frame = chip8_i->frames;
+}
+
+// Write the final frame count and close, a replay runs exactly that many frames
+int CHIP8_record_close(CHIP8_recorder_t *recorder, const CHIP8_t *chip8_i) {
+  uint8_t frames[8];
+  put_le(frames, chip8_i->frames, 8);
+  int ret = fseek(recorder->file, CHIP8_INPUT_FRAMES_AT, SEEK_SET) || fwrite(frames, sizeof(frames), 1, recorder->file) != 1;
+  if (fclose(recorder->file)) ret = -1;
+  if (ret) fprintf(stderr, "Could not finish input recording\n");
+  free(recorder);
+  return ret ? -1 : 0;
+}
+
+// Open a recording and read its header, the caller sets the instance up from it and loads the ROM before running it
+CHIP8_replay_t* CHIP8_replay_open(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Could not open recording %s\n", path);
+    return NULL;
+  }
+  uint8_t header[CHIP8_INPUT_HEADER];
+  if (fread(header, sizeof(header), 1, file) != 1 || memcmp(header, CHIP8_INPUT_MAGIC, 4)) {
+    fprintf(stderr, "%s is not a CHIP8 input recording\n", path);
+    fclose(file);
+    return NULL;
+  }
+  if (get_le(header + 4, 2) != CHIP8_INPUT_VERSION) {
+    fprintf(stderr, "%s: unsupported recording version %u\n", path, (unsigned)get_le(header + 4, 2));
+    fclose(file);
+    return NULL;
+  }
+  const uint64_t quirks = get_le(header + 6, 2);
+  if (quirks >= CHIP8_QUIRKS_COUNT) {
+    fprintf(stderr, "%s: unknown quirk profile %u\n", path, (unsigned)quirks);
+    fclose(file);
+    return NULL;
+  }
+  CHIP8_replay_t *replay = malloc(sizeof(CHIP8_replay_t));
+  if (replay == NULL) {
+    fprintf(stderr, "Could not allocate replay\n");
+    fclose(file);
+    return NULL;
+  }
+  replay->file = file;
+  replay->quirks = (CHIP8_quirks_t)quirks;
+  replay->seed = get_le(header + 8, 8);
+  replay->clock_rate = get_le(header + 16, 4);
+  memcpy(replay->sha1, header + CHIP8_INPUT_SHA1_AT, CHIP8_SHA1_SIZE);
+  replay->frames = get_le(header + CHIP8_INPUT_FRAMES_AT, 8);
+  return replay;
+}
+
+void CHIP8_replay_close(CHIP8_replay_t *replay) {
+  if (replay == NULL) return;
+  fclose(replay->file);
+  free(replay);
+}
+
+// Feed the recording into an instance as fast as possible. It must have been set up with the recording's
+// seed, clock rate and quirk profile and have the recorded ROM freshly loaded, the result is then the
+// same state the recorded session ended in.
+int CHIP8_replay_run(CHIP8_replay_t *replay, CHIP8_t *chip8_i) {
+  // next event, read ahead of the frame it applies to
+  bool pending = false;
+  bool done = false;
+  uint64_t event_frame = 0;
+  uint16_t keys = 0;
+  chip8_i->run_state = RUNNING;
+  while (chip8_i->run_state == RUNNING && chip8_i->frames < replay->frames) {
+    for (;;) {
+      if (!pending && !done) {
+        uint64_t delta = 0;
+        int c, shift = 0;
+        do {
+          c = fgetc(replay->file);
+          if (c == EOF) break;
+          // ten 7 bit groups hold any u64, a longer varint is a corrupt recording
+          if (shift > 63 || (shift == 63 && (c & 0x7E))) {
+            fprintf(stderr, "Bad frame delta in recording after frame %llu\n", (unsigned long long)event_frame);
+            return -1;
+          }
+          delta |= (uint64_t)(c & 0x7F) << shift;
+          shift += 7;
+        } while (c & 0x80);
+        uint8_t bits[2];
+        if (c == EOF || fread(bits, sizeof(bits), 1, replay->file) != 1) {
+          done = true;
+          break;
+        }
+        event_frame += delta;
+        keys = get_le(bits, 2);
+        pending = true;
+      }
+      if (!pending || event_frame != chip8_i->frames) break;
+      for (int i = 0; i < 0x10; i++) chip8_i->keypad[i] = (keys >> i) & 1;
+      pending = false;
+    }
+    CHIP8_emulate_frame(chip8_i);
+  }
+  return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "rom.h"
+
+// Input recording file format, all integers little endian:
+//   "CH8I" magic, u16 version, u16 quirk profile, u64 seed, u32 clock rate, SHA-1 of the ROM, u64 frames recorded
+//   events until the end of the file: varint frames since the previous event, u16 keypad bits after the change
+#define CHIP8_INPUT_MAGIC "CH8I"
+#define CHIP8_INPUT_VERSION 2
+
+typedef struct {
+  FILE *file;
+  uint16_t keys;       // keypad bits as of the last event
+  uint64_t last_frame; // frame of the last event
+} CHIP8_recorder_t;
+
+CHIP8_recorder_t* CHIP8_record_open(const char *path, const CHIP8_t *chip8_i, const uint8_t sha1[CHIP8_SHA1_SIZE]);
+void CHIP8_record_frame(CHIP8_recorder_t *recorder, const CHIP8_t *chip8_i);
+int CHIP8_record_close(CHIP8_recorder_t *recorder, const CHIP8_t *chip8_i);
+
+// A recording opened for playback, the header says how to set up the instance before the ROM is loaded
+typedef struct {
+  FILE *file;
+  CHIP8_quirks_t quirks;
+  uint64_t seed;
+  uint32_t clock_rate;
+  uint8_t sha1[CHIP8_SHA1_SIZE]; // of the ROM the session was recorded with
+  uint64_t frames;
+} CHIP8_replay_t;
+
+CHIP8_replay_t* CHIP8_replay_open(const char *path);
+int CHIP8_replay_run(CHIP8_replay_t *replay, CHIP8_t *chip8_i);
+void CHIP8_replay_close(CHIP8_replay_t *replay);
+
+#endif
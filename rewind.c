@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "state.h"
+#include "rewind.h"
+
+enum { CHIP8_REWIND_DELTA, CHIP8_REWIND_FULL };
+
+// runs closer than this are merged, a run header costs 6 bytes
+#define CHIP8_REWIND_GAP 6
+// kind + cycles + a whole state block, the largest payload a record can have
+#define CHIP8_REWIND_MAX_PAYLOAD (1 + 8 + CHIP8_STATE_SIZE)
+#define CHIP8_REWIND_MIN_BYTES (4 * (CHIP8_REWIND_MAX_PAYLOAD + 8))
+
+CHIP8_rewind_t* CHIP8_rewind_create(size_t bytes) {
+  if (bytes < CHIP8_REWIND_MIN_BYTES) bytes = CHIP8_REWIND_MIN_BYTES;
+  CHIP8_rewind_t *rewind = malloc(sizeof(CHIP8_rewind_t));
+  if (rewind == NULL) {
+    fprintf(stderr, "Could not allocate rewind buffer\n");
+    return NULL;
+  }
+  rewind->ring = malloc(bytes);
+  rewind->scratch = malloc(CHIP8_REWIND_MAX_PAYLOAD);
+  if (rewind->ring == NULL || rewind->scratch == NULL) {
+    fprintf(stderr, "Could not allocate %zu byte rewind buffer\n", bytes);
+    free(rewind->ring);
+    free(rewind->scratch);
+    free(rewind);
+    return NULL;
+  }
+  rewind->capacity = bytes;
+  CHIP8_rewind_reset(rewind);
+  return rewind;
+}
+
+void CHIP8_rewind_destroy(CHIP8_rewind_t *rewind) {
+  if (rewind == NULL) return;
+  free(rewind->ring);
+  free(rewind->scratch);
+  free(rewind);
+}
+
+// Forget all history, the next record only primes the previous snapshot
+void CHIP8_rewind_reset(CHIP8_rewind_t *rewind) {
+  rewind->head = 0;
+  rewind->used = 0;
+  rewind->frames = 0;
+  rewind->since_keyframe = 0;
+  rewind->primed = false;
+}
+
+// copy len bytes into/out of the ring starting at pos, wrapping at the end
+static void ring_write(CHIP8_rewind_t *rewind, size_t pos, const void *src, size_t len) {
+  const size_t first = len < rewind->capacity - pos ? len : rewind->capacity - pos;
+  memcpy(rewind->ring + pos, src, first);
+  memcpy(rewind->ring, (const uint8_t *)src + first, len - first);
+}
+
+static void ring_read(const CHIP8_rewind_t *rewind, size_t pos, void *dst, size_t len) {
+  const size_t first = len < rewind->capacity - pos ? len : rewind->capacity - pos;
+  memcpy(dst, rewind->ring + pos, first);
+  memcpy((uint8_t *)dst + first, rewind->ring, len - first);
+}
+
+static size_t ring_back(const CHIP8_rewind_t *rewind, size_t pos, size_t len) {
+  return (pos + rewind->capacity - len) % rewind->capacity;
+}
+
+// Drop the oldest record
+static void CHIP8_rewind_drop(CHIP8_rewind_t *rewind) {
+  const size_t tail = ring_back(rewind, rewind->head, rewind->used);
+  uint32_t size;
+  ring_read(rewind, tail, &size, sizeof(size));
+  rewind->used -= size + 2*sizeof(size);
+  rewind->frames--;
+}
+
+static void CHIP8_rewind_push(CHIP8_rewind_t *rewind, const uint8_t *payload, uint32_t size) {
+  const size_t total = size + 2*sizeof(size);
+  while (rewind->capacity - rewind->used < total) {
+    CHIP8_rewind_drop(rewind);
+  }
+  ring_write(rewind, rewind->head, &size, sizeof(size));
+  ring_write(rewind, (rewind->head + sizeof(size)) % rewind->capacity, payload, size);
+  ring_write(rewind, (rewind->head + sizeof(size) + size) % rewind->capacity, &size, sizeof(size));
+  rewind->head = (rewind->head + total) % rewind->capacity;
+  rewind->used += total;
+  rewind->frames++;
+}
+
+// Encode prev ^ cur as runs, returns the payload size or 0 if a keyframe would be as small
+static uint32_t CHIP8_rewind_encode_delta(CHIP8_rewind_t *rewind) {
+  const uint8_t *a = rewind->prev.state;
+  const uint8_t *b = rewind->cur.state;
+  uint8_t *out = rewind->scratch;
+  uint8_t *const end = rewind->scratch + 1 + sizeof(uint64_t) + rewind->prev.size;
+  // a frame that changed the profile, and with it how much memory is live, gets a keyframe
+  if (rewind->prev.size != rewind->cur.size) return 0;
+  const size_t used = rewind->prev.size;
+  *out++ = CHIP8_REWIND_DELTA;
+  memcpy(out, &rewind->prev.cycles, sizeof(uint64_t));
+  out += sizeof(uint64_t);
+
+  size_t i = 0;
+  while (i < used) {
+    // compare 8 bytes at a time through the unchanged parts, most of the block is memory that didn't move
+    while (i + 8 <= used && !memcmp(a + i, b + i, 8)) i += 8;
+    while (i < used && a[i] == b[i]) i++;
+    if (i >= used) break;
+    const size_t start = i;
+    size_t last = i;
+    while (i < used && i - last <= CHIP8_REWIND_GAP && i - start < 0xFFFF) {
+      if (a[i] != b[i]) last = i;
+      i++;
+    }
+    const uint32_t offset = start;
+    const uint16_t len = last - start + 1;
+    if (out + 6 + len > end) return 0;
+    memcpy(out, &offset, 4);
+    memcpy(out + 4, &len, 2);
+    out += 6;
+    for (size_t j = 0; j < len; j++) {
+      out[j] = a[start + j] ^ b[start + j];
+    }
+    out += len;
+    i = last + 1;
+  }
+  return out - rewind->scratch;
+}
+
+// Call once per emulated frame, stores how to get from this frame back to the previous one
+void CHIP8_rewind_record(CHIP8_rewind_t *rewind, const CHIP8_t *chip8_i) {
+  if (!rewind->primed) {
+    CHIP8_snapshot_take(chip8_i, &rewind->prev);
+    rewind->primed = true;
+    return;
+  }
+  CHIP8_snapshot_take(chip8_i, &rewind->cur);
+
+  uint32_t size = 0;
+  if (rewind->since_keyframe < CHIP8_REWIND_KEYFRAME) {
+    size = CHIP8_rewind_encode_delta(rewind);
+  }
+  if (size == 0) {
+    rewind->scratch[0] = CHIP8_REWIND_FULL;
+    memcpy(rewind->scratch + 1, &rewind->prev.cycles, sizeof(uint64_t));
+    memcpy(rewind->scratch + 1 + sizeof(uint64_t), rewind->prev.state, rewind->prev.size);
+    size = 1 + sizeof(uint64_t) + rewind->prev.size;
+    rewind->since_keyframe = 0;
+  } else {
+    rewind->since_keyframe++;
+  }
+  CHIP8_rewind_push(rewind, rewind->scratch, size);
+  // the used part only, the rest of the block is stale either way
+  rewind->prev.cycles = rewind->cur.cycles;
+  rewind->prev.skipped = rewind->cur.skipped;
+  rewind->prev.size = rewind->cur.size;
+  memcpy(rewind->prev.state, rewind->cur.state, rewind->cur.size);
+}
+
+// Step the instance back one recorded frame, false when there is no history left.
+// The keypad is left as the user is holding it now rather than as it was recorded.
+bool CHIP8_rewind_step(CHIP8_rewind_t *rewind, CHIP8_t *chip8_i) {
+  if (!rewind->primed || rewind->frames == 0) return false;
+
+  uint32_t size;
+  const size_t trailer = ring_back(rewind, rewind->head, sizeof(size));
+  ring_read(rewind, trailer, &size, sizeof(size));
+  ring_read(rewind, ring_back(rewind, trailer, size), rewind->scratch, size);
+  rewind->head = ring_back(rewind, trailer, size + sizeof(size));
+  rewind->used -= size + 2*sizeof(size);
+  rewind->frames--;
+  if (rewind->since_keyframe) rewind->since_keyframe--;
+
+  const uint8_t *in = rewind->scratch + 1;
+  memcpy(&rewind->prev.cycles, in, sizeof(uint64_t));
+  in += sizeof(uint64_t);
+  if (rewind->scratch[0] == CHIP8_REWIND_FULL) {
+    rewind->prev.size = size - 1 - sizeof(uint64_t);
+    memcpy(rewind->prev.state, in, rewind->prev.size);
+  } else {
+    const uint8_t *const end = rewind->scratch + size;
+    while (in < end) {
+      uint32_t offset;
+      uint16_t len;
+      memcpy(&offset, in, 4);
+      memcpy(&len, in + 4, 2);
+      in += 6;
+      for (size_t j = 0; j < len; j++) {
+        rewind->prev.state[offset + j] ^= in[j];
+      }
+      in += len;
+    }
+  }
+
+  bool keypad[sizeof(chip8_i->keypad)];
+  memcpy(keypad, chip8_i->keypad, sizeof(keypad));
+  CHIP8_snapshot_restore(chip8_i, &rewind->prev);
+  memcpy(chip8_i->keypad, keypad, sizeof(keypad));
+  return true;
+}
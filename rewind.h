@@ -0,0 +1,38 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "chip8.h"
+#include "state.h"
+
+// a full snapshot is stored every this many frames, everything in between is an XOR delta
+#define CHIP8_REWIND_KEYFRAME 600
+
+// Fixed size ring of per-frame records, newest at head, oldest dropped first when full.
+// Each record is [u32 size][payload][u32 size] so it can be walked from either end.
+// A delta record holds the XOR of the machine state block before and after a frame as
+// (u32 offset, u16 length, bytes) runs, so stepping back is XOR-ing the runs into the previous snapshot.
+typedef struct {
+  uint8_t *ring;
+  size_t capacity;  // bytes in ring
+  size_t head;      // next byte to write
+  size_t used;      // bytes between the oldest record and head
+  uint32_t frames;  // records currently in the ring
+  uint32_t since_keyframe;
+  bool primed;      // prev holds the state after the newest record
+  CHIP8_snapshot_t prev;
+  CHIP8_snapshot_t cur;
+  uint8_t *scratch; // encoding buffer, large enough for a keyframe
+} CHIP8_rewind_t;
+
+CHIP8_rewind_t* CHIP8_rewind_create(size_t bytes);
+void CHIP8_rewind_destroy(CHIP8_rewind_t *rewind);
+void CHIP8_rewind_reset(CHIP8_rewind_t *rewind);
+
+void CHIP8_rewind_record(CHIP8_rewind_t *rewind, const CHIP8_t *chip8_i);
+bool CHIP8_rewind_step(CHIP8_rewind_t *rewind, CHIP8_t *chip8_i);
+
+#endif
@@ -0,0 +1,341 @@
+#define _POSIX_C_SOURCE 200809L // strdup, mmap
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chip8.h"
+#include "rom.h"
+
+// Map the file and hash it, the pages are shared with every other process that has it open
+CHIP8_rom_t* CHIP8_rom_open(const char *path) {
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to read ROM %s\n", path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    fprintf(stderr, "%s is not a ROM file\n", path);
+    close(fd);
+    return NULL;
+  }
+  CHIP8_rom_t *rom = malloc(sizeof(CHIP8_rom_t));
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (rom == NULL || data == MAP_FAILED) {
+    fprintf(stderr, "Could not map ROM %s\n", path);
+    if (data != MAP_FAILED) munmap(data, st.st_size);
+    free(rom);
+    return NULL;
+  }
+  rom->data = data;
+  rom->size = st.st_size;
+  CHIP8_sha1(rom->data, rom->size, rom->sha1);
+  return rom;
+}
+
+void CHIP8_rom_close(CHIP8_rom_t *rom) {
+  if (rom == NULL) return;
+  munmap((void *)rom->data, rom->size);
+  free(rom);
+}
+
+static uint32_t rol32(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+// SHA-1 of one 64 byte block into h
+static void CHIP8_sha1_block(uint32_t h[5], const uint8_t *block) {
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[4*i] << 24) | ((uint32_t)block[4*i + 1] << 16) | ((uint32_t)block[4*i + 2] << 8) | block[4*i + 3];
+  }
+  for (int i = 16; i < 80; i++) {
+    w[i] = rol32(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+  }
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+  for (int i = 0; i < 80; i++) {
+    uint32_t f, k;
+    if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+    else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+    else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+    else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+    const uint32_t t = rol32(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rol32(b, 30);
+    b = a;
+    a = t;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+}
+
+// SHA-1, only used to name ROMs so the database can recognise them whatever the file is called
+void CHIP8_sha1(const uint8_t *data, size_t size, uint8_t digest[CHIP8_SHA1_SIZE]) {
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    CHIP8_sha1_block(h, data + i);
+  }
+  // the tail, a 1 bit, zero padding and the length in bits, one or two blocks
+  uint8_t last[128] = { 0 };
+  const size_t tail = size - i;
+  memcpy(last, data + i, tail);
+  last[tail] = 0x80;
+  const size_t blocks = tail < 56 ? 1 : 2;
+  const uint64_t bits = (uint64_t)size * 8;
+  for (int b = 0; b < 8; b++) {
+    last[blocks*64 - 1 - b] = (bits >> (8*b)) & 0xFF;
+  }
+  for (size_t b = 0; b < blocks; b++) {
+    CHIP8_sha1_block(h, last + 64*b);
+  }
+  for (int j = 0; j < 5; j++) {
+    digest[4*j] = h[j] >> 24;
+    digest[4*j + 1] = (h[j] >> 16) & 0xFF;
+    digest[4*j + 2] = (h[j] >> 8) & 0xFF;
+    digest[4*j + 3] = h[j] & 0xFF;
+  }
+}
+
+typedef struct {
+  char *path;
+  const CHIP8_rom_t *rom;
+} CHIP8_rom_path_t;
+
+// Two open addressing tables, both kept at most half full: path -> image and contents -> image.
+// The second one owns the images.
+struct CHIP8_rom_cache_s {
+  pthread_mutex_t lock;
+  CHIP8_rom_path_t *paths;
+  size_t path_capacity; // power of two
+  size_t path_count;
+  CHIP8_rom_t **roms;
+  size_t rom_capacity;  // power of two
+  size_t rom_count;
+};
+
+static uint64_t CHIP8_path_hash(const char *path) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (; *path; path++) {
+    hash = (hash ^ (uint8_t)*path) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+// the digest is already uniformly distributed, its first 8 bytes are the hash
+static uint64_t CHIP8_sha1_hash(const uint8_t sha1[CHIP8_SHA1_SIZE]) {
+  uint64_t hash;
+  memcpy(&hash, sha1, sizeof(hash));
+  return hash;
+}
+
+CHIP8_rom_cache_t* CHIP8_rom_cache_create(void) {
+  CHIP8_rom_cache_t *cache = calloc(1, sizeof(CHIP8_rom_cache_t));
+  if (cache == NULL) {
+    fprintf(stderr, "Could not allocate ROM cache\n");
+    return NULL;
+  }
+  cache->path_capacity = 64;
+  cache->rom_capacity = 64;
+  cache->paths = calloc(cache->path_capacity, sizeof(CHIP8_rom_path_t));
+  cache->roms = calloc(cache->rom_capacity, sizeof(CHIP8_rom_t *));
+  if (cache->paths == NULL || cache->roms == NULL) {
+    fprintf(stderr, "Could not allocate ROM cache\n");
+    free(cache->paths);
+    free(cache->roms);
+    free(cache);
+    return NULL;
+  }
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
+
+void CHIP8_rom_cache_destroy(CHIP8_rom_cache_t *cache) {
+  if (cache == NULL) return;
+  for (size_t i = 0; i < cache->path_capacity; i++) free(cache->paths[i].path);
+  for (size_t i = 0; i < cache->rom_capacity; i++) CHIP8_rom_close(cache->roms[i]);
+  free(cache->paths);
+  free(cache->roms);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+static CHIP8_rom_path_t *CHIP8_cache_find_path(CHIP8_rom_path_t *paths, size_t capacity, const char *path) {
+  size_t i = CHIP8_path_hash(path) & (capacity - 1);
+  while (paths[i].path && strcmp(paths[i].path, path)) i = (i + 1) & (capacity - 1);
+  return &paths[i];
+}
+
+static CHIP8_rom_t **CHIP8_cache_find_rom(CHIP8_rom_t **roms, size_t capacity, const uint8_t sha1[CHIP8_SHA1_SIZE]) {
+  size_t i = CHIP8_sha1_hash(sha1) & (capacity - 1);
+  while (roms[i] && memcmp(roms[i]->sha1, sha1, CHIP8_SHA1_SIZE)) i = (i + 1) & (capacity - 1);
+  return &roms[i];
+}
+
+// double both tables when they get half full, called with the lock held
+static int CHIP8_cache_grow(CHIP8_rom_cache_t *cache) {
+  if (2 * (cache->path_count + 1) > cache->path_capacity) {
+    const size_t capacity = cache->path_capacity * 2;
+    CHIP8_rom_path_t *paths = calloc(capacity, sizeof(CHIP8_rom_path_t));
+    if (paths == NULL) return -1;
+    for (size_t i = 0; i < cache->path_capacity; i++) {
+      if (cache->paths[i].path) *CHIP8_cache_find_path(paths, capacity, cache->paths[i].path) = cache->paths[i];
+    }
+    free(cache->paths);
+    cache->paths = paths;
+    cache->path_capacity = capacity;
+  }
+  if (2 * (cache->rom_count + 1) > cache->rom_capacity) {
+    const size_t capacity = cache->rom_capacity * 2;
+    CHIP8_rom_t **roms = calloc(capacity, sizeof(CHIP8_rom_t *));
+    if (roms == NULL) return -1;
+    for (size_t i = 0; i < cache->rom_capacity; i++) {
+      if (cache->roms[i]) *CHIP8_cache_find_rom(roms, capacity, cache->roms[i]->sha1) = cache->roms[i];
+    }
+    free(cache->roms);
+    cache->roms = roms;
+    cache->rom_capacity = capacity;
+  }
+  return 0;
+}
+
+// The image for path, opened on first use. Workers only hold the lock for the lookups,
+// mapping and hashing a new file happens outside it.
+const CHIP8_rom_t* CHIP8_rom_cache_get(CHIP8_rom_cache_t *cache, const char *path) {
+  pthread_mutex_lock(&cache->lock);
+  const CHIP8_rom_t *found = CHIP8_cache_find_path(cache->paths, cache->path_capacity, path)->rom;
+  pthread_mutex_unlock(&cache->lock);
+  if (found) return found;
+
+  CHIP8_rom_t *rom = CHIP8_rom_open(path);
+  if (rom == NULL) return NULL;
+  char *key = strdup(path);
+
+  pthread_mutex_lock(&cache->lock);
+  if (key == NULL || CHIP8_cache_grow(cache)) {
+    pthread_mutex_unlock(&cache->lock);
+    fprintf(stderr, "Could not grow ROM cache\n");
+    free(key);
+    CHIP8_rom_close(rom);
+    return NULL;
+  }
+  CHIP8_rom_path_t *slot = CHIP8_cache_find_path(cache->paths, cache->path_capacity, path);
+  if (slot->rom) {
+    // another worker opened it meanwhile
+    free(key);
+    CHIP8_rom_close(rom);
+  } else {
+    CHIP8_rom_t **image = CHIP8_cache_find_rom(cache->roms, cache->rom_capacity, rom->sha1);
+    if (*image) {
+      // same contents under another name, share the first image
+      CHIP8_rom_close(rom);
+    } else {
+      *image = rom;
+      cache->rom_count++;
+    }
+    slot->path = key;
+    slot->rom = *image;
+    cache->path_count++;
+  }
+  found = slot->rom;
+  pthread_mutex_unlock(&cache->lock);
+  return found;
+}
+
+static int CHIP8_hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static int CHIP8_parse_sha1(const char *hex, uint8_t sha1[CHIP8_SHA1_SIZE]) {
+  if (strlen(hex) != 2 * CHIP8_SHA1_SIZE) return -1;
+  for (int i = 0; i < CHIP8_SHA1_SIZE; i++) {
+    const int hi = CHIP8_hex_digit(hex[2*i]), lo = CHIP8_hex_digit(hex[2*i + 1]);
+    if (hi < 0 || lo < 0) return -1;
+    sha1[i] = (hi << 4) | lo;
+  }
+  return 0;
+}
+
+static int CHIP8_romdb_cmp(const void *a, const void *b) {
+  return memcmp(((const CHIP8_romdb_entry_t *)a)->sha1, ((const CHIP8_romdb_entry_t *)b)->sha1, CHIP8_SHA1_SIZE);
+}
+
+// Read a database, bad lines are reported and skipped
+int CHIP8_romdb_load(CHIP8_romdb_t *db, const char *path) {
+  db->entries = NULL;
+  db->count = 0;
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "Could not open ROM database %s\n", path);
+    return -1;
+  }
+  size_t capacity = 0;
+  char line[1024];
+  int lineno = 0;
+  while (fgets(line, sizeof(line), file)) {
+    lineno++;
+    char *fields[3] = { NULL };
+    int nfields = 0;
+    for (char *tok = strtok(line, " \t\r\n"); tok && nfields < 3; tok = strtok(NULL, " \t\r\n")) {
+      if (tok[0] == '#') break;
+      fields[nfields++] = tok;
+    }
+    if (!nfields) continue;
+    CHIP8_romdb_entry_t entry = { .clock_rate = 0, .quirks = CHIP8_QUIRKS_MODERN, .has_quirks = false };
+    if (CHIP8_parse_sha1(fields[0], entry.sha1)) {
+      fprintf(stderr, "%s:%d: bad SHA-1 %s\n", path, lineno, fields[0]);
+      continue;
+    }
+    if (nfields > 1) entry.clock_rate = (uint32_t)strtoul(fields[1], NULL, 0);
+    if (nfields > 2) {
+      if (CHIP8_quirks_from_name(fields[2], &entry.quirks)) {
+        fprintf(stderr, "%s:%d: unknown quirk profile %s\n", path, lineno, fields[2]);
+        continue;
+      }
+      entry.has_quirks = true;
+    }
+    if (db->count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      CHIP8_romdb_entry_t *resized = realloc(db->entries, capacity * sizeof(CHIP8_romdb_entry_t));
+      if (resized == NULL) {
+        fprintf(stderr, "Could not allocate ROM database\n");
+        fclose(file);
+        CHIP8_romdb_free(db);
+        return -1;
+      }
+      db->entries = resized;
+    }
+    db->entries[db->count++] = entry;
+  }
+  fclose(file);
+  qsort(db->entries, db->count, sizeof(CHIP8_romdb_entry_t), CHIP8_romdb_cmp);
+  return 0;
+}
+
+void CHIP8_romdb_free(CHIP8_romdb_t *db) {
+  free(db->entries);
+  db->entries = NULL;
+  db->count = 0;
+}
+
+const CHIP8_romdb_entry_t* CHIP8_romdb_find(const CHIP8_romdb_t *db, const uint8_t sha1[CHIP8_SHA1_SIZE]) {
+  CHIP8_romdb_entry_t key;
+  memcpy(key.sha1, sha1, CHIP8_SHA1_SIZE);
+  return db->count ? bsearch(&key, db->entries, db->count, sizeof(CHIP8_romdb_entry_t), CHIP8_romdb_cmp) : NULL;
+}
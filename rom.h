@@ -0,0 +1,49 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "chip8.h"
+
+#define CHIP8_SHA1_SIZE 20
+
+// A ROM file mapped read-only into memory, identified by the SHA-1 of its contents
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  uint8_t sha1[CHIP8_SHA1_SIZE];
+} CHIP8_rom_t;
+
+CHIP8_rom_t* CHIP8_rom_open(const char *path);
+void CHIP8_rom_close(CHIP8_rom_t *rom);
+void CHIP8_sha1(const uint8_t *data, size_t size, uint8_t digest[CHIP8_SHA1_SIZE]);
+
+// Thread safe cache of opened ROMs for batch runs. Each path is mapped once and files with the same
+// contents share one image, the ROMs stay mapped until the cache is destroyed.
+typedef struct CHIP8_rom_cache_s CHIP8_rom_cache_t;
+
+CHIP8_rom_cache_t* CHIP8_rom_cache_create(void);
+void CHIP8_rom_cache_destroy(CHIP8_rom_cache_t *cache);
+const CHIP8_rom_t* CHIP8_rom_cache_get(CHIP8_rom_cache_t *cache, const char *path);
+
+// ROM database, one ROM per line: "sha1 [clock-rate [quirks]]", blank lines and # comments ignored,
+// a clock rate of 0 keeps the default
+typedef struct {
+  uint8_t sha1[CHIP8_SHA1_SIZE];
+  uint32_t clock_rate;
+  CHIP8_quirks_t quirks;
+  bool has_quirks;
+} CHIP8_romdb_entry_t;
+
+typedef struct {
+  CHIP8_romdb_entry_t *entries; // sorted by sha1
+  size_t count;
+} CHIP8_romdb_t;
+
+int CHIP8_romdb_load(CHIP8_romdb_t *db, const char *path);
+void CHIP8_romdb_free(CHIP8_romdb_t *db);
+const CHIP8_romdb_entry_t* CHIP8_romdb_find(const CHIP8_romdb_t *db, const uint8_t sha1[CHIP8_SHA1_SIZE]);
+
+#endif
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sched.h"
+
+// due time of frame k relative to the origin, rounded up so frame k is due exactly when
+// elapsed * CHIP8_SCHED_HZ / 1e9 reaches k
+static uint64_t frame_time(uint64_t k) {
+  return (k * 1000000000ull + CHIP8_SCHED_HZ - 1) / CHIP8_SCHED_HZ;
+}
+
+void CHIP8_sched_start(CHIP8_sched_t *sched, uint64_t now_ns) {
+  *sched = (CHIP8_sched_t){ .origin_ns = now_ns, .last_ns = now_ns };
+}
+
+// Number of frames to emulate now, 0 if the next one isn't due yet.
+// Under load up to CHIP8_SCHED_MAX_CATCHUP frames are run to catch up, the rest are skipped.
+uint32_t CHIP8_sched_due(CHIP8_sched_t *sched, uint64_t now_ns) {
+  sched->active_ns += now_ns - sched->last_ns;
+  sched->last_ns = now_ns;
+  if (now_ns < sched->origin_ns + frame_time(sched->scheduled)) return 0;
+
+  const uint64_t late = now_ns - (sched->origin_ns + frame_time(sched->scheduled));
+  sched->wakeups++;
+  sched->late_ns += late;
+  if (late > sched->late_max_ns) sched->late_max_ns = late;
+
+  // frames 0 .. target-1 are due by now
+  const uint64_t target = (now_ns - sched->origin_ns) * CHIP8_SCHED_HZ / 1000000000ull + 1;
+  uint64_t due = target - sched->scheduled;
+  if (due > CHIP8_SCHED_MAX_CATCHUP) {
+    sched->skipped += due - CHIP8_SCHED_MAX_CATCHUP;
+    sched->scheduled += due - CHIP8_SCHED_MAX_CATCHUP;
+    due = CHIP8_SCHED_MAX_CATCHUP;
+  }
+  sched->scheduled += due;
+  sched->frames += due;
+  return due;
+}
+
+// Time the next frame is due
+uint64_t CHIP8_sched_next(const CHIP8_sched_t *sched) {
+  return sched->origin_ns + frame_time(sched->scheduled);
+}
+
+void CHIP8_sched_pause(CHIP8_sched_t *sched, uint64_t now_ns) {
+  if (sched->paused) return;
+  sched->active_ns += now_ns - sched->last_ns;
+  sched->last_ns = now_ns;
+  sched->paused = true;
+}
+
+// Carry on from the next frame as if it were due now, a pause doesn't count as falling behind
+void CHIP8_sched_resume(CHIP8_sched_t *sched, uint64_t now_ns) {
+  if (!sched->paused) return;
+  sched->origin_ns = now_ns - frame_time(sched->scheduled);
+  sched->last_ns = now_ns;
+  sched->paused = false;
+}
+
+void CHIP8_sched_report(const CHIP8_sched_t *sched, uint32_t clock_rate, FILE *out) {
+  const double secs = sched->active_ns / 1e9;
+  const double hz = secs > 0 ? sched->frames / secs : 0.0;
+  fprintf(out, "target %d Hz, %u instr/s | achieved %.2f Hz, %.0f instr/s over %.1f s | %llu frames, %llu skipped | wakeup late avg %.3f ms, max %.3f ms\n",
+    CHIP8_SCHED_HZ,
+    clock_rate,
+    hz,
+    hz * clock_rate / CHIP8_SCHED_HZ,
+    secs,
+    (unsigned long long)sched->frames,
+    (unsigned long long)sched->skipped,
+    sched->wakeups ? sched->late_ns / 1e6 / sched->wakeups : 0.0,
+    sched->late_max_ns / 1e6);
+}
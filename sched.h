@@ -0,0 +1,34 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Real time frame scheduler, knows nothing about SDL, the caller passes monotonic nanoseconds in.
+// Frame k of a run is due exactly k * 1e9 / 60 ns after the origin, computed from k every time so the
+// rate never drifts, and the timers tick once per frame whatever the render rate is.
+#define CHIP8_SCHED_HZ 60
+#define CHIP8_SCHED_MAX_CATCHUP 4 // frames run back to back after a stall, anything beyond is skipped
+
+typedef struct {
+  uint64_t origin_ns;   // time frame 0 was due
+  uint64_t scheduled;   // frames since origin handed out or skipped
+  uint64_t last_ns;     // time of the last CHIP8_sched_due
+  uint64_t active_ns;   // wall time spent running, pauses excluded
+  uint64_t frames;      // frames handed out
+  uint64_t skipped;     // frames dropped because the host fell too far behind
+  uint64_t wakeups;     // calls that had at least one frame due
+  uint64_t late_ns;     // total and worst lateness of those wakeups
+  uint64_t late_max_ns;
+  bool paused;
+} CHIP8_sched_t;
+
+void CHIP8_sched_start(CHIP8_sched_t *sched, uint64_t now_ns);
+uint32_t CHIP8_sched_due(CHIP8_sched_t *sched, uint64_t now_ns);
+uint64_t CHIP8_sched_next(const CHIP8_sched_t *sched);
+void CHIP8_sched_pause(CHIP8_sched_t *sched, uint64_t now_ns);
+void CHIP8_sched_resume(CHIP8_sched_t *sched, uint64_t now_ns);
+void CHIP8_sched_report(const CHIP8_sched_t *sched, uint32_t clock_rate, FILE *out);
+
+#endif
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "state.h"
+
+#define CHIP8_STATE_REGS (0x10 + 2 + 2 + 1 + 1 + 1 + 1 + 12*2 + 2 + 8 + 1 + 1 + 0x10 + sizeof(((CHIP8_t *)0)->display))
+#define CHIP8_STATE_MAX_FILE (40 + CHIP8_STATE_REGS + 4 + CHIP8_MEMORY_SIZE / CHIP8_STATE_PAGE / 8 + CHIP8_MEMORY_SIZE)
+
+void CHIP8_snapshot_take(const CHIP8_t *chip8_i, CHIP8_snapshot_t *snapshot) {
+  snapshot->cycles = chip8_i->cycles;
+  snapshot->skipped = chip8_i->skipped;
+  snapshot->size = CHIP8_STATE_USED(chip8_i);
+  memcpy(snapshot->state, (const uint8_t *)chip8_i + CHIP8_STATE_START, snapshot->size);
+}
+
+void CHIP8_snapshot_restore(CHIP8_t *chip8_i, const CHIP8_snapshot_t *snapshot) {
+  chip8_i->cycles = snapshot->cycles;
+  chip8_i->skipped = snapshot->skipped;
+  chip8_i->fault = CHIP8_FAULT_NONE;
+  memcpy((uint8_t *)chip8_i + CHIP8_STATE_START, snapshot->state, CHIP8_STATE_MM_OFFSET);
+  // only pages that differ are copied and lose their predecoded code, a run-ahead or rewind step rarely touches any
+  CHIP8_write_memory(chip8_i, snapshot->state + CHIP8_STATE_MM_OFFSET, snapshot->size - CHIP8_STATE_MM_OFFSET);
+  CHIP8_mark_dirty(chip8_i);
+}
+
+void CHIP8_run_ahead(CHIP8_t *chip8_i, CHIP8_snapshot_t *save, uint32_t frames,
+  uint64_t display[CHIP8_PLANES][DISPLAY_MAX_HEIGHT][DISPLAY_WORDS], bool *hires) {
+  CHIP8_snapshot_take(chip8_i, save);
+  const uint64_t frames_now = chip8_i->frames;
+  const e_state_t run_state = chip8_i->run_state;
+  struct CHIP8_audio_s *audio = chip8_i->audio;
+  struct CHIP8_trace_s *trace = chip8_i->trace;
+  chip8_i->audio = NULL;
+  chip8_i->trace = NULL;
+  // a prediction that quits or faults is shown as it ended, the real frame gets to decide
+  for (uint32_t i = 0; i < frames && chip8_i->run_state == RUNNING; i++) {
+    CHIP8_emulate_frame(chip8_i);
+  }
+  memcpy(display, chip8_i->display, sizeof(chip8_i->display));
+  *hires = chip8_i->hires;
+  CHIP8_snapshot_restore(chip8_i, save);
+  chip8_i->frames = frames_now;
+  chip8_i->run_state = run_state;
+  chip8_i->audio = audio;
+  chip8_i->trace = trace;
+}
+
+// FNV-1a of a snapshot's main memory, ties a delta to the base it was taken against
+static uint64_t CHIP8_snapshot_memory_hash(const CHIP8_snapshot_t *snapshot) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  const uint8_t *MM = snapshot->state + CHIP8_STATE_MM_OFFSET;
+  for (size_t i = 0; i < snapshot->size - CHIP8_STATE_MM_OFFSET; i++) {
+    hash = (hash ^ MM[i]) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+static uint8_t *put8(uint8_t *p, uint8_t v) {
+  *p++ = v;
+  return p;
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v) {
+  *p++ = v & 0xFF;
+  *p++ = v >> 8;
+  return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    *p++ = (v >> (8*i)) & 0xFF;
+  }
+  return p;
+}
+
+static uint8_t *put64(uint8_t *p, uint64_t v) {
+  for (int i = 0; i < 8; i++) {
+    *p++ = (v >> (8*i)) & 0xFF;
+  }
+  return p;
+}
+
+static uint16_t get16(const uint8_t **p) {
+  uint16_t v = (*p)[0] | ((*p)[1] << 8);
+  *p += 2;
+  return v;
+}
+
+static uint32_t get32(const uint8_t **p) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++) {
+    v |= (uint32_t)(*p)[i] << (8*i);
+  }
+  *p += 4;
+  return v;
+}
+
+static uint64_t get64(const uint8_t **p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) {
+    v |= (uint64_t)(*p)[i] << (8*i);
+  }
+  *p += 8;
+  return v;
+}
+
+// Write the instance's state to path, as a delta against base when one is given
+int CHIP8_state_write(const CHIP8_t *chip8_i, const char *path, const CHIP8_snapshot_t *base) {
+  if (base && base->size != CHIP8_STATE_USED(chip8_i)) {
+    fprintf(stderr, "%s: the base state has %u bytes of memory, this profile %u\n", path,
+      (unsigned)(base->size - CHIP8_STATE_MM_OFFSET), chip8_i->mem_mask + 1u);
+    return -1;
+  }
+  uint8_t *buffer = malloc(CHIP8_STATE_MAX_FILE);
+  if (buffer == NULL) {
+    fprintf(stderr, "Could not allocate state buffer\n");
+    return -1;
+  }
+  uint8_t *p = buffer;
+
+  memcpy(p, CHIP8_STATE_MAGIC, 4);
+  p += 4;
+  p = put16(p, CHIP8_STATE_VERSION);
+  p = put8(p, base ? 1 : 0);
+  p = put8(p, chip8_i->quirks);
+  p = put64(p, chip8_i->cycles);
+  p = put64(p, chip8_i->frames);
+  p = put64(p, chip8_i->seed);
+  p = put64(p, base ? CHIP8_snapshot_memory_hash(base) : 0);
+
+  for (int i = 0; i < 0x10; i++) p = put8(p, chip8_i->V[i]);
+  p = put16(p, chip8_i->PC);
+  p = put16(p, chip8_i->I);
+  p = put8(p, chip8_i->S);
+  p = put8(p, chip8_i->D);
+  p = put8(p, chip8_i->cycle_frac);
+  p = put8(p, chip8_i->SP);
+  for (int i = 0; i < CHIP8_STACK_SIZE; i++) p = put16(p, chip8_i->stack[i]);
+  uint16_t keys = 0;
+  for (int i = 0; i < 0x10; i++) keys |= chip8_i->keypad[i] << i;
+  p = put16(p, keys);
+  p = put64(p, chip8_i->rng);
+  p = put8(p, chip8_i->hires);
+  p = put8(p, chip8_i->planes);
+  for (int i = 0; i < 0x10; i++) p = put8(p, chip8_i->flags[i]);
+  const uint64_t *words = &chip8_i->display[0][0][0];
+  for (size_t i = 0; i < sizeof(chip8_i->display) / sizeof(uint64_t); i++) p = put64(p, words[i]);
+
+  // only the memory the profile can address
+  const uint32_t memory = chip8_i->mem_mask + 1u;
+  const size_t pages = memory / CHIP8_STATE_PAGE;
+  p = put32(p, memory);
+  if (base) {
+    // only the pages of main memory that differ from the base
+    const uint8_t *base_MM = base->state + CHIP8_STATE_MM_OFFSET;
+    uint8_t *mask = p;
+    memset(mask, 0, pages / 8);
+    p += pages / 8;
+    for (size_t page = 0; page < pages; page++) {
+      if (memcmp(&chip8_i->MM[page * CHIP8_STATE_PAGE], &base_MM[page * CHIP8_STATE_PAGE], CHIP8_STATE_PAGE)) {
+        mask[page / 8] |= 1u << (page % 8);
+        memcpy(p, &chip8_i->MM[page * CHIP8_STATE_PAGE], CHIP8_STATE_PAGE);
+        p += CHIP8_STATE_PAGE;
+      }
+    }
+  } else {
+    memcpy(p, chip8_i->MM, memory);
+    p += memory;
+  }
+
+  int ret = 0;
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    fprintf(stderr, "Could not open %s for writing\n", path);
+    ret = -1;
+  } else {
+    if (fwrite(buffer, p - buffer, 1, file) != 1) {
+      fprintf(stderr, "Could not write state to %s\n", path);
+      ret = -1;
+    }
+    fclose(file);
+  }
+  free(buffer);
+  return ret;
+}
+
+// Apply the size bytes of a state file in buffer to the instance, MM is scratch space for the new main memory
+// which is assembled before touching the instance so a short file leaves it unchanged
+static int CHIP8_state_parse(CHIP8_t *chip8_i, const char *path, const CHIP8_snapshot_t *base, const uint8_t *buffer, size_t size, uint8_t *MM) {
+  const size_t header = 4 + 2 + 1 + 1 + 8 + 8 + 8 + 8;
+  const uint8_t *p = buffer;
+  if (size < header + CHIP8_STATE_REGS + 4 || memcmp(p, CHIP8_STATE_MAGIC, 4)) {
+    fprintf(stderr, "%s is not a CHIP8 state\n", path);
+    return -1;
+  }
+  p += 4;
+  const uint16_t version = get16(&p);
+  const uint8_t kind = *p++;
+  const uint8_t quirks = *p++;
+  if (version != CHIP8_STATE_VERSION || kind > 1 || quirks >= CHIP8_QUIRKS_COUNT) {
+    fprintf(stderr, "%s: unsupported state version %u kind %u profile %u\n", path, version, kind, quirks);
+    return -1;
+  }
+  const uint64_t cycles = get64(&p);
+  const uint64_t frames = get64(&p);
+  const uint64_t seed = get64(&p);
+  const uint64_t base_hash = get64(&p);
+  if (kind == 1 && (!base || CHIP8_snapshot_memory_hash(base) != base_hash)) {
+    fprintf(stderr, "%s: delta state needs the base state it was written against\n", path);
+    return -1;
+  }
+
+  // SP is the one register that indexes host memory, V, PC, I, S, D and cycle_frac come before it
+  const uint8_t sp = p[0x10 + 2 + 2 + 3];
+  if (sp > CHIP8_STACK_SIZE) {
+    fprintf(stderr, "%s: bad stack pointer %u\n", path, sp);
+    return -1;
+  }
+
+  const uint8_t *mem = p + CHIP8_STATE_REGS;
+  const uint32_t memory = get32(&mem);
+  if (memory > CHIP8_MEMORY_SIZE || memory % (8 * CHIP8_STATE_PAGE)) {
+    fprintf(stderr, "%s: bad memory size %u\n", path, (unsigned)memory);
+    return -1;
+  }
+  const size_t pages = memory / CHIP8_STATE_PAGE;
+  if (kind == 1) {
+    if (memory != base->size - CHIP8_STATE_MM_OFFSET) {
+      fprintf(stderr, "%s: delta state has %u bytes of memory, its base %u\n", path,
+        (unsigned)memory, (unsigned)(base->size - CHIP8_STATE_MM_OFFSET));
+      return -1;
+    }
+    memcpy(MM, base->state + CHIP8_STATE_MM_OFFSET, memory);
+    memset(MM + memory, 0, CHIP8_MEMORY_SIZE - memory);
+    if (mem + pages / 8 > buffer + size) {
+      fprintf(stderr, "%s: truncated state\n", path);
+      return -1;
+    }
+    const uint8_t *mask = mem;
+    mem += pages / 8;
+    for (size_t page = 0; page < pages; page++) {
+      if (!(mask[page / 8] & (1u << (page % 8)))) continue;
+      if (mem + CHIP8_STATE_PAGE > buffer + size) {
+        fprintf(stderr, "%s: truncated state\n", path);
+        return -1;
+      }
+      memcpy(&MM[page * CHIP8_STATE_PAGE], mem, CHIP8_STATE_PAGE);
+      mem += CHIP8_STATE_PAGE;
+    }
+    // every page the mask names has been read, anything after them means the mask doesn't match the file
+    if (mem != buffer + size) {
+      fprintf(stderr, "%s: %zu bytes after the last page\n", path, (size_t)(buffer + size - mem));
+      return -1;
+    }
+  } else {
+    if (mem + memory > buffer + size) {
+      fprintf(stderr, "%s: truncated state\n", path);
+      return -1;
+    }
+    if (mem + memory != buffer + size) {
+      fprintf(stderr, "%s: %zu bytes after main memory\n", path, (size_t)(buffer + size - mem - memory));
+      return -1;
+    }
+    memcpy(MM, mem, memory);
+    memset(MM + memory, 0, CHIP8_MEMORY_SIZE - memory);
+  }
+
+  // the threaded blocks are translated for a profile, only a profile change needs them all dropped
+  const bool flush = quirks != chip8_i->quirks;
+
+  CHIP8_set_quirks(chip8_i, quirks);
+  for (int i = 0; i < 0x10; i++) chip8_i->V[i] = *p++;
+  chip8_i->PC = get16(&p);
+  chip8_i->I = get16(&p);
+  chip8_i->S = *p++;
+  chip8_i->D = *p++;
+  chip8_i->cycle_frac = *p++ % 60;
+  chip8_i->SP = *p++;
+  for (int i = 0; i < CHIP8_STACK_SIZE; i++) chip8_i->stack[i] = get16(&p);
+  const uint16_t keys = get16(&p);
+  for (int i = 0; i < 0x10; i++) chip8_i->keypad[i] = (keys >> i) & 1;
+  chip8_i->rng = get64(&p);
+  chip8_i->hires = *p++ != 0;
+  chip8_i->planes = *p++ & 0x3;
+  for (int i = 0; i < 0x10; i++) chip8_i->flags[i] = *p++;
+  uint64_t *words = &chip8_i->display[0][0][0];
+  for (size_t i = 0; i < sizeof(chip8_i->display) / sizeof(uint64_t); i++) words[i] = get64(&p);
+  chip8_i->cycles = cycles;
+  chip8_i->frames = frames;
+  chip8_i->skipped = 0;
+  chip8_i->seed = seed;
+  chip8_i->fault = CHIP8_FAULT_NONE;
+
+  if (flush) {
+    memcpy(chip8_i->MM, MM, CHIP8_MEMORY_SIZE);
+    CHIP8_flush_caches(chip8_i);
+  } else {
+    CHIP8_write_memory(chip8_i, MM, CHIP8_MEMORY_SIZE);
+  }
+  CHIP8_mark_dirty(chip8_i);
+  return 0;
+}
+
+// Load a state written by CHIP8_state_write, delta states need the same base they were written against
+int CHIP8_state_read(CHIP8_t *chip8_i, const char *path, const CHIP8_snapshot_t *base) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    fprintf(stderr, "Could not open state %s\n", path);
+    return -1;
+  }
+  uint8_t *buffer = malloc(CHIP8_STATE_MAX_FILE + 1 + CHIP8_MEMORY_SIZE);
+  if (buffer == NULL) {
+    fprintf(stderr, "Could not allocate state buffer\n");
+    fclose(file);
+    return -1;
+  }
+  // one byte more than the largest state so a longer file is caught rather than cut short
+  const size_t size = fread(buffer, 1, CHIP8_STATE_MAX_FILE + 1, file);
+  fclose(file);
+  if (size > CHIP8_STATE_MAX_FILE) {
+    fprintf(stderr, "%s: larger than any CHIP8 state\n", path);
+    free(buffer);
+    return -1;
+  }
+  const int ret = CHIP8_state_parse(chip8_i, path, base, buffer, size, buffer + CHIP8_STATE_MAX_FILE + 1);
+  free(buffer);
+  return ret;
+}
@@ -0,0 +1,43 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+// Save state file format, all integers little endian, no pointers:
+//   "CH8S" magic, u16 version, u8 kind (0 full, 1 delta), u8 quirk profile
+//   u64 cycles, u64 frames, u64 seed, u64 base hash (hash of the base state for deltas, 0 for full states)
+//   registers: V0-VF, u16 PC, u16 I, u8 S, u8 D, u8 cycle_frac, u8 SP, u16 stack[12], u16 keypad bits, u64 rng,
+//              u8 hires, u8 planes, u8 flags[16], u64 display words[2][64][2]
+//   u32 size of main memory, 4K or 64K depending on the profile
+//   full:  main memory
+//   delta: bitmask of changed 256 byte pages of main memory, a byte per 8 pages, then those pages in order
+#define CHIP8_STATE_MAGIC "CH8S"
+#define CHIP8_STATE_VERSION 4
+#define CHIP8_STATE_PAGE 0x100
+
+// In memory snapshot, taking or restoring one is a memcpy of the used part of the machine state block.
+// Snapshots are restored into the instance they were taken from, or one set to the same quirk profile.
+typedef struct {
+  uint64_t cycles;
+  uint64_t skipped;
+  uint32_t size; // bytes of state in use, CHIP8_STATE_USED of the instance
+  uint8_t state[CHIP8_STATE_SIZE];
+} CHIP8_snapshot_t;
+
+void CHIP8_snapshot_take(const CHIP8_t *chip8_i, CHIP8_snapshot_t *snapshot);
+void CHIP8_snapshot_restore(CHIP8_t *chip8_i, const CHIP8_snapshot_t *snapshot);
+
+// Run-ahead: emulate frames past the present with the keypad as it is now, copy the display they end on into
+// display and hires, then restore the machine from save exactly as it was, frame count and run state included.
+// The frames are never heard or traced, with STATS their instructions are counted like any others.
+#define CHIP8_RUN_AHEAD_MAX 8
+void CHIP8_run_ahead(CHIP8_t *chip8_i, CHIP8_snapshot_t *save, uint32_t frames,
+  uint64_t display[CHIP8_PLANES][DISPLAY_MAX_HEIGHT][DISPLAY_WORDS], bool *hires);
+
+int CHIP8_state_write(const CHIP8_t *chip8_i, const char *path, const CHIP8_snapshot_t *base);
+int CHIP8_state_read(CHIP8_t *chip8_i, const char *path, const CHIP8_snapshot_t *base);
+
+#endif
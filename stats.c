@@ -0,0 +1,125 @@
+#ifdef CHIP8_STATS
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "chip8.h"
+#include "stats.h"
+
+volatile sig_atomic_t CHIP8_stats_requested = 0;
+
+const char *CHIP8_stats_path = "chip8-stats.json";
+
+static const char *const phase_names[CHIP8_PHASE_COUNT] = { "emulate", "render", "sleep" };
+
+// batch jobs poll from their worker threads, one writer at a time and one of them per request
+static pthread_mutex_t CHIP8_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// s as a JSON string literal, the ROM path is whatever the user passed
+static void CHIP8_stats_json_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    const unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+static void CHIP8_stats_write_json(const CHIP8_t *chip8_i, FILE *out) {
+  const CHIP8_stats_t *stats = chip8_i->stats;
+  fprintf(out, "{\n  \"rom\": ");
+  CHIP8_stats_json_string(out, chip8_i->rom);
+  fprintf(out, ",\n  \"cycles\": %llu,\n  \"frames\": %llu,\n  \"skipped\": %llu,\n",
+    (unsigned long long)chip8_i->cycles, (unsigned long long)chip8_i->frames, (unsigned long long)chip8_i->skipped);
+  fprintf(out, "  \"ops\": {");
+  for (int op = 0; op < CHIP8_OP_COUNT; op++) {
+    fprintf(out, "%s\n    \"%s\": %llu", op ? "," : "", CHIP8_op_names[op], (unsigned long long)stats->ops[op]);
+  }
+  // the heatmap is sparse, only addresses that ran
+  fprintf(out, "\n  },\n  \"heatmap\": [");
+  bool first = true;
+  for (int pc = 0; pc <= chip8_i->mem_mask; pc++) {
+    if (!stats->heat[pc]) continue;
+    fprintf(out, "%s\n    [%d, %llu]", first ? "" : ",", pc, (unsigned long long)stats->heat[pc]);
+    first = false;
+  }
+  fprintf(out, "\n  ],\n  \"histograms_ns_log2\": {");
+  for (int phase = 0; phase < CHIP8_PHASE_COUNT; phase++) {
+    fprintf(out, "%s\n    \"%s\": [", phase ? "," : "", phase_names[phase]);
+    for (int b = 0; b < CHIP8_STATS_BUCKETS; b++) {
+      fprintf(out, "%s%llu", b ? ", " : "", (unsigned long long)stats->hist[phase][b]);
+    }
+    fprintf(out, "]");
+  }
+  fprintf(out, "\n  }\n}\n");
+}
+
+// one row per value: section,key,count
+static void CHIP8_stats_write_csv(const CHIP8_t *chip8_i, FILE *out) {
+  const CHIP8_stats_t *stats = chip8_i->stats;
+  fprintf(out, "section,key,count\n");
+  fprintf(out, "run,cycles,%llu\nrun,frames,%llu\nrun,skipped,%llu\n",
+    (unsigned long long)chip8_i->cycles, (unsigned long long)chip8_i->frames, (unsigned long long)chip8_i->skipped);
+  for (int op = 0; op < CHIP8_OP_COUNT; op++) {
+    fprintf(out, "op,%s,%llu\n", CHIP8_op_names[op], (unsigned long long)stats->ops[op]);
+  }
+  for (int pc = 0; pc <= chip8_i->mem_mask; pc++) {
+    if (stats->heat[pc]) fprintf(out, "pc,0x%04X,%llu\n", pc, (unsigned long long)stats->heat[pc]);
+  }
+  for (int phase = 0; phase < CHIP8_PHASE_COUNT; phase++) {
+    for (int b = 0; b < CHIP8_STATS_BUCKETS; b++) {
+      if (stats->hist[phase][b]) fprintf(out, "%s,%llu,%llu\n", phase_names[phase], 1ull << b, (unsigned long long)stats->hist[phase][b]);
+    }
+  }
+}
+
+static int CHIP8_stats_write_locked(const CHIP8_t *chip8_i, const char *path) {
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Could not open %s for stats\n", path);
+    return -1;
+  }
+  const size_t len = strlen(path);
+  if (len > 4 && !strcmp(path + len - 4, ".csv")) {
+    CHIP8_stats_write_csv(chip8_i, out);
+  } else {
+    CHIP8_stats_write_json(chip8_i, out);
+  }
+  fclose(out);
+  return 0;
+}
+
+// Write the counters to path, CSV if it ends in .csv and JSON otherwise
+int CHIP8_stats_write(const CHIP8_t *chip8_i, const char *path) {
+  if (chip8_i->stats == NULL) return -1;
+  pthread_mutex_lock(&CHIP8_stats_lock);
+  const int ret = CHIP8_stats_write_locked(chip8_i, path);
+  pthread_mutex_unlock(&CHIP8_stats_lock);
+  return ret;
+}
+
+// Called once per frame, writes the stats if a signal asked for them since the last call.
+// In a batch the first job to see the request writes its own stats, the others find it taken.
+void CHIP8_stats_poll(const CHIP8_t *chip8_i) {
+  if (!CHIP8_stats_requested || chip8_i->stats == NULL) return;
+  pthread_mutex_lock(&CHIP8_stats_lock);
+  if (CHIP8_stats_requested) {
+    CHIP8_stats_requested = 0;
+    if (!CHIP8_stats_write_locked(chip8_i, CHIP8_stats_path)) {
+      fprintf(stderr, "Stats written to %s\n", CHIP8_stats_path);
+    }
+  }
+  pthread_mutex_unlock(&CHIP8_stats_lock);
+}
+
+#endif
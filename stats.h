@@ -0,0 +1,61 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+
+#include "chip8.h"
+
+// Build with -DCHIP8_STATS (make STATS=1) to count executed instructions per class and per PC and to
+// histogram frame timings. Without it every CHIP8_STAT_* macro is empty and nothing is linked in.
+
+// frame phases with a timing histogram
+typedef enum {
+  CHIP8_PHASE_EMULATE,
+  CHIP8_PHASE_RENDER,
+  CHIP8_PHASE_SLEEP,
+  CHIP8_PHASE_COUNT
+} CHIP8_phase_t;
+
+#define CHIP8_STATS_BUCKETS 32 // bucket b counts durations in [2^b, 2^(b+1)) ns
+
+#ifdef CHIP8_STATS
+
+struct CHIP8_stats_s {
+  uint64_t ops[CHIP8_OP_COUNT];  // executions per instruction class
+  uint64_t heat[CHIP8_MEMORY_SIZE]; // executions per PC, every address an XO-CHIP program can run from
+  uint64_t hist[CHIP8_PHASE_COUNT][CHIP8_STATS_BUCKETS];
+};
+typedef struct CHIP8_stats_s CHIP8_stats_t;
+
+// set from a signal handler, the next frame writes the stats
+extern volatile sig_atomic_t CHIP8_stats_requested;
+extern const char *CHIP8_stats_path; // where a requested dump goes, JSON unless it ends in .csv
+
+static inline void CHIP8_stats_exec(CHIP8_stats_t *stats, uint16_t pc, uint8_t op) {
+  if (op >= CHIP8_OP_COUNT) return; // end of a threaded block
+  stats->ops[op]++;
+  stats->heat[pc]++;
+}
+
+static inline void CHIP8_stats_time(CHIP8_stats_t *stats, CHIP8_phase_t phase, uint64_t ns) {
+  const int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+  stats->hist[phase][bucket < CHIP8_STATS_BUCKETS ? bucket : CHIP8_STATS_BUCKETS - 1]++;
+}
+
+int CHIP8_stats_write(const CHIP8_t *chip8_i, const char *path);
+void CHIP8_stats_poll(const CHIP8_t *chip8_i);
+
+  #define CHIP8_STAT_EXEC(chip8_i, pc, op) CHIP8_stats_exec((chip8_i)->stats, (pc), (op))
+  #define CHIP8_STAT_TIME(chip8_i, phase, ns) CHIP8_stats_time((chip8_i)->stats, (phase), (ns))
+  #define CHIP8_STAT_POLL(chip8_i) CHIP8_stats_poll(chip8_i)
+  #define CHIP8_STAT_FINISH(chip8_i) ((void)CHIP8_stats_write((chip8_i), CHIP8_stats_path))
+#else
+  #define CHIP8_STAT_EXEC(chip8_i, pc, op) ((void)0)
+  #define CHIP8_STAT_TIME(chip8_i, phase, ns) ((void)0)
+  #define CHIP8_STAT_POLL(chip8_i) ((void)0)
+  #define CHIP8_STAT_FINISH(chip8_i) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,249 @@
+#define _POSIX_C_SOURCE 200809L // nanosleep
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "trace.h"
+
+// records packed per fwrite by the flush thread
+#define CHIP8_TRACE_CHUNK 256
+
+static void put_le(uint8_t *p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    p[i] = (v >> (8*i)) & 0xFF;
+  }
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) {
+    v |= (uint64_t)p[i] << (8*i);
+  }
+  return v;
+}
+
+// A record as it is laid out in the file, the same on every host
+static void CHIP8_trace_pack(const CHIP8_trace_record_t *record, uint8_t *p) {
+  put_le(p, record->cycle, 8);
+  put_le(p + 8, record->pc, 2);
+  put_le(p + 10, record->opcode, 2);
+  put_le(p + 12, record->I, 2);
+  p[14] = record->VX;
+  p[15] = record->VY;
+}
+
+static void CHIP8_trace_unpack(const uint8_t *p, CHIP8_trace_record_t *record) {
+  record->cycle = get_le(p, 8);
+  record->pc = get_le(p + 8, 2);
+  record->opcode = get_le(p + 10, 2);
+  record->I = get_le(p + 12, 2);
+  record->VX = p[14];
+  record->VY = p[15];
+}
+
+// Background thread, moves whatever the emulator has written to the file and sleeps when there's nothing.
+// After a failed write it keeps draining the ring so the emulator isn't left dropping records, but writes nothing more.
+static void *CHIP8_trace_flush(void *data) {
+  CHIP8_trace_t *trace = data;
+  const struct timespec idle = { .tv_sec = 0, .tv_nsec = 1000000 };
+  uint8_t chunk[CHIP8_TRACE_CHUNK * CHIP8_TRACE_RECORD_SIZE];
+  for (;;) {
+    const bool stopping = atomic_load_explicit(&trace->stop, memory_order_acquire);
+    const uint64_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+    if (head == tail) {
+      if (stopping) break;
+      nanosleep(&idle, NULL);
+      continue;
+    }
+    // up to the end of the ring, the wrapped part goes on the next pass
+    const size_t start = tail & trace->mask;
+    size_t count = head - tail;
+    if (start + count > trace->mask + 1) count = trace->mask + 1 - start;
+    if (count > CHIP8_TRACE_CHUNK) count = CHIP8_TRACE_CHUNK;
+    if (!trace->failed) {
+      for (size_t i = 0; i < count; i++) {
+        CHIP8_trace_pack(&trace->ring[start + i], &chunk[i * CHIP8_TRACE_RECORD_SIZE]);
+      }
+      trace->failed = fwrite(chunk, CHIP8_TRACE_RECORD_SIZE, count, trace->out) != count;
+    }
+    tail += count;
+    atomic_store_explicit(&trace->tail, tail, memory_order_release);
+  }
+  return NULL;
+}
+
+// Start tracing to path, records is rounded up to a power of two. quirks is the profile the traced
+// instance runs, the decoder needs it to tell BNNN from BXNN
+CHIP8_trace_t* CHIP8_trace_open(const char *path, size_t records, CHIP8_quirks_t quirks) {
+  size_t size = 1;
+  while (size < records) size <<= 1;
+  CHIP8_trace_t *trace = malloc(sizeof(CHIP8_trace_t));
+  if (trace == NULL) {
+    fprintf(stderr, "Could not allocate tracer\n");
+    return NULL;
+  }
+  trace->ring = malloc(size * sizeof(CHIP8_trace_record_t));
+  trace->out = fopen(path, "wb");
+  if (trace->ring == NULL || trace->out == NULL) {
+    fprintf(stderr, "Could not start tracing to %s\n", path);
+    if (trace->out) fclose(trace->out);
+    free(trace->ring);
+    free(trace);
+    return NULL;
+  }
+  trace->mask = size - 1;
+  atomic_init(&trace->head, 0);
+  atomic_init(&trace->tail, 0);
+  atomic_init(&trace->enabled, true);
+  atomic_init(&trace->stop, false);
+  trace->next_cycle = 0;
+  trace->dropped = 0;
+  trace->failed = false;
+
+  uint8_t header[CHIP8_TRACE_HEADER];
+  memcpy(header, CHIP8_TRACE_MAGIC, 4);
+  put_le(header + 4, CHIP8_TRACE_VERSION, 2);
+  put_le(header + 6, CHIP8_TRACE_RECORD_SIZE, 2);
+  put_le(header + 8, quirks, 2);
+  if (fwrite(header, sizeof(header), 1, trace->out) != 1) {
+    fprintf(stderr, "Could not write trace header to %s\n", path);
+    fclose(trace->out);
+    free(trace->ring);
+    free(trace);
+    return NULL;
+  }
+  if (pthread_create(&trace->flusher, NULL, CHIP8_trace_flush, trace)) {
+    fprintf(stderr, "Could not start trace flush thread\n");
+    fclose(trace->out);
+    free(trace->ring);
+    free(trace);
+    return NULL;
+  }
+  return trace;
+}
+
+// Flush everything still in the ring and close the file, detach it from the instance first
+void CHIP8_trace_close(CHIP8_trace_t *trace) {
+  if (trace == NULL) return;
+  atomic_store_explicit(&trace->stop, true, memory_order_release);
+  pthread_join(trace->flusher, NULL);
+  if (trace->dropped) {
+    fprintf(stderr, "Trace: %llu records dropped, the flush thread fell behind\n", (unsigned long long)trace->dropped);
+  }
+  if (fclose(trace->out) || trace->failed) {
+    fprintf(stderr, "Trace: could not write the trace file, it is incomplete\n");
+  }
+  free(trace->ring);
+  free(trace);
+}
+
+void CHIP8_trace_enable(CHIP8_trace_t *trace, bool enabled) {
+  atomic_store_explicit(&trace->enabled, enabled, memory_order_relaxed);
+}
+
+// Assembly for one opcode as the quirk profile runs it, Cowgod's mnemonics
+void CHIP8_disassemble(uint16_t opcode, CHIP8_quirks_t quirks, char *buf, size_t size) {
+  const unsigned X = (opcode >> 8) & 0xF, Y = (opcode >> 4) & 0xF, N = opcode & 0xF, NN = opcode & 0xFF, NNN = opcode & 0xFFF;
+  switch (CHIP8_decode_op(opcode)) {
+    case CHIP8_OP_0NNN: snprintf(buf, size, "SYS  0x%03X", NNN); break;
+    case CHIP8_OP_00E0: snprintf(buf, size, "CLS"); break;
+    case CHIP8_OP_00EE: snprintf(buf, size, "RET"); break;
+    case CHIP8_OP_1NNN: snprintf(buf, size, "JP   0x%03X", NNN); break;
+    case CHIP8_OP_2NNN: snprintf(buf, size, "CALL 0x%03X", NNN); break;
+    case CHIP8_OP_3XNN: snprintf(buf, size, "SE   V%X, 0x%02X", X, NN); break;
+    case CHIP8_OP_4XNN: snprintf(buf, size, "SNE  V%X, 0x%02X", X, NN); break;
+    case CHIP8_OP_5XY0: snprintf(buf, size, "SE   V%X, V%X", X, Y); break;
+    case CHIP8_OP_6XNN: snprintf(buf, size, "LD   V%X, 0x%02X", X, NN); break;
+    case CHIP8_OP_7XNN: snprintf(buf, size, "ADD  V%X, 0x%02X", X, NN); break;
+    case CHIP8_OP_8XY0: snprintf(buf, size, "LD   V%X, V%X", X, Y); break;
+    case CHIP8_OP_8XY1: snprintf(buf, size, "OR   V%X, V%X", X, Y); break;
+    case CHIP8_OP_8XY2: snprintf(buf, size, "AND  V%X, V%X", X, Y); break;
+    case CHIP8_OP_8XY3: snprintf(buf, size, "XOR  V%X, V%X", X, Y); break;
+    case CHIP8_OP_8XY4: snprintf(buf, size, "ADD  V%X, V%X", X, Y); break;
+    case CHIP8_OP_8XY5: snprintf(buf, size, "SUB  V%X, V%X", X, Y); break;
+    case CHIP8_OP_8XY6: snprintf(buf, size, "SHR  V%X, V%X", X, Y); break;
+    case CHIP8_OP_8XY7: snprintf(buf, size, "SUBN V%X, V%X", X, Y); break;
+    case CHIP8_OP_8XYE: snprintf(buf, size, "SHL  V%X, V%X", X, Y); break;
+    case CHIP8_OP_9XY0: snprintf(buf, size, "SNE  V%X, V%X", X, Y); break;
+    case CHIP8_OP_ANNN: snprintf(buf, size, "LD   I, 0x%03X", NNN); break;
+    case CHIP8_OP_BNNN:
+      if (CHIP8_quirk_jump_vx[quirks]) {
+        snprintf(buf, size, "JP   V%X, 0x%03X", X, NNN);
+      } else {
+        snprintf(buf, size, "JP   V0, 0x%03X", NNN);
+      }
+      break;
+    case CHIP8_OP_CXNN: snprintf(buf, size, "RND  V%X, 0x%02X", X, NN); break;
+    case CHIP8_OP_DXYN: snprintf(buf, size, "DRW  V%X, V%X, %u", X, Y, N); break;
+    case CHIP8_OP_EX9E: snprintf(buf, size, "SKP  V%X", X); break;
+    case CHIP8_OP_EXA1: snprintf(buf, size, "SKNP V%X", X); break;
+    case CHIP8_OP_FX07: snprintf(buf, size, "LD   V%X, DT", X); break;
+    case CHIP8_OP_FX0A: snprintf(buf, size, "LD   V%X, K", X); break;
+    case CHIP8_OP_FX15: snprintf(buf, size, "LD   DT, V%X", X); break;
+    case CHIP8_OP_FX18: snprintf(buf, size, "LD   ST, V%X", X); break;
+    case CHIP8_OP_FX1E: snprintf(buf, size, "ADD  I, V%X", X); break;
+    case CHIP8_OP_FX29: snprintf(buf, size, "LD   F, V%X", X); break;
+    case CHIP8_OP_FX33: snprintf(buf, size, "LD   B, V%X", X); break;
+    case CHIP8_OP_FX55: snprintf(buf, size, "LD   [I], V%X", X); break;
+    case CHIP8_OP_FX65: snprintf(buf, size, "LD   V%X, [I]", X); break;
+    case CHIP8_OP_00CN: snprintf(buf, size, "SCD  %u", N); break;
+    case CHIP8_OP_00FB: snprintf(buf, size, "SCR"); break;
+    case CHIP8_OP_00FC: snprintf(buf, size, "SCL"); break;
+    case CHIP8_OP_00FD: snprintf(buf, size, "EXIT"); break;
+    case CHIP8_OP_00FE: snprintf(buf, size, "LOW"); break;
+    case CHIP8_OP_00FF: snprintf(buf, size, "HIGH"); break;
+    case CHIP8_OP_FX30: snprintf(buf, size, "LD   HF, V%X", X); break;
+    case CHIP8_OP_FX75: snprintf(buf, size, "LD   R, V%X", X); break;
+    case CHIP8_OP_FX85: snprintf(buf, size, "LD   V%X, R", X); break;
+    case CHIP8_OP_00DN: snprintf(buf, size, "SCU  %u", N); break;
+    case CHIP8_OP_5XY2: snprintf(buf, size, "SAVE V%X, V%X", X, Y); break;
+    case CHIP8_OP_5XY3: snprintf(buf, size, "LOAD V%X, V%X", X, Y); break;
+    case CHIP8_OP_F000: snprintf(buf, size, "LD   I, LONG"); break;
+    case CHIP8_OP_FN01: snprintf(buf, size, "PLANE %u", X); break;
+    case CHIP8_OP_NOP:  snprintf(buf, size, "NOP  (0x%04X)", opcode); break;
+    case CHIP8_OP_INVALID:
+    default:            snprintf(buf, size, "DW   0x%04X", opcode); break;
+  }
+}
+
+// Offline decoder, one line per record
+int CHIP8_trace_decode(const char *path, FILE *out) {
+  FILE *in = fopen(path, "rb");
+  if (in == NULL) {
+    fprintf(stderr, "Could not open trace %s\n", path);
+    return -1;
+  }
+  uint8_t header[CHIP8_TRACE_HEADER];
+  if (fread(header, sizeof(header), 1, in) != 1 || memcmp(header, CHIP8_TRACE_MAGIC, 4)
+      || get_le(header + 4, 2) != CHIP8_TRACE_VERSION || get_le(header + 6, 2) != CHIP8_TRACE_RECORD_SIZE
+      || get_le(header + 8, 2) >= CHIP8_QUIRKS_COUNT) {
+    fprintf(stderr, "%s is not a trace this build can read\n", path);
+    fclose(in);
+    return -1;
+  }
+  const uint64_t profile = get_le(header + 8, 2);
+  const CHIP8_quirks_t quirks = (CHIP8_quirks_t)profile;
+  uint8_t chunk[CHIP8_TRACE_CHUNK * CHIP8_TRACE_RECORD_SIZE];
+  size_t count;
+  char text[32];
+  while ((count = fread(chunk, CHIP8_TRACE_RECORD_SIZE, CHIP8_TRACE_CHUNK, in)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      CHIP8_trace_record_t record;
+      const CHIP8_trace_record_t *r = &record;
+      CHIP8_trace_unpack(&chunk[i * CHIP8_TRACE_RECORD_SIZE], &record);
+      CHIP8_disassemble(r->opcode, quirks, text, sizeof(text));
+      fprintf(out, "%12llu  %03X  %04X  %-18s I=%03X VX=%02X VY=%02X\n",
+        (unsigned long long)r->cycle, r->pc, r->opcode, text, r->I, r->VX, r->VY);
+    }
+  }
+  fclose(in);
+  return 0;
+}
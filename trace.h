@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+
+// Trace file, all integers little endian: "CH8T" magic, u16 version, u16 record size, u16 quirk profile,
+// then records of u64 cycle, u16 pc, u16 opcode, u16 I, u8 VX, u8 VY
+#define CHIP8_TRACE_MAGIC "CH8T"
+#define CHIP8_TRACE_VERSION 2
+#define CHIP8_TRACE_HEADER (4 + 2 + 2 + 2)
+#define CHIP8_TRACE_RECORD_SIZE (8 + 2 + 2 + 2 + 1 + 1)
+
+// One executed instruction, registers as they were before it ran, as the ring holds it
+typedef struct {
+  uint64_t cycle;  // instructions executed before this one
+  uint16_t pc;
+  uint16_t opcode;
+  uint16_t I;
+  uint8_t VX;      // the registers the opcode names in its X and Y nibbles
+  uint8_t VY;
+} CHIP8_trace_record_t;
+
+// Single producer (the emulator) / single consumer (the flush thread) ring of records.
+// The producer never waits, if the flush thread falls a whole ring behind records are dropped and counted.
+typedef struct CHIP8_trace_s {
+  CHIP8_trace_record_t *ring;
+  size_t mask;              // ring size - 1, the size is a power of two
+  _Atomic uint64_t head;    // next record to write, producer only
+  _Atomic uint64_t tail;    // next record to flush, consumer only
+  _Atomic bool enabled;     // runtime switch, a disabled tracer only counts cycles
+  _Atomic bool stop;
+  uint64_t next_cycle;      // cycle number of the next instruction, producer only
+  uint64_t dropped;         // producer only
+  bool failed;              // a write to out failed and the flush thread stopped writing, consumer only
+  FILE *out;
+  pthread_t flusher;
+} CHIP8_trace_t;
+
+CHIP8_trace_t* CHIP8_trace_open(const char *path, size_t records, CHIP8_quirks_t quirks);
+void CHIP8_trace_close(CHIP8_trace_t *trace);
+void CHIP8_trace_enable(CHIP8_trace_t *trace, bool enabled);
+int CHIP8_trace_decode(const char *path, FILE *out);
+void CHIP8_disassemble(uint16_t opcode, CHIP8_quirks_t quirks, char *buf, size_t size);
+
+static inline void CHIP8_trace_exec(CHIP8_trace_t *trace, const CHIP8_t *chip8_i, uint16_t pc, uint16_t opcode) {
+  const uint64_t cycle = trace->next_cycle++;
+  if (!atomic_load_explicit(&trace->enabled, memory_order_relaxed)) return;
+  const uint64_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&trace->tail, memory_order_acquire) > trace->mask) {
+    trace->dropped++;
+    return;
+  }
+  CHIP8_trace_record_t *record = &trace->ring[head & trace->mask];
+  record->cycle = cycle;
+  record->pc = pc;
+  record->opcode = opcode;
+  record->I = chip8_i->I;
+  record->VX = chip8_i->V[(opcode >> 8) & 0xF];
+  record->VY = chip8_i->V[(opcode >> 4) & 0xF];
+  atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
+
+// one branch per instruction while no tracer is attached
+#define CHIP8_TRACE_EXEC(chip8_i, pc, opcode) \
+  do { if ((chip8_i)->trace) CHIP8_trace_exec((chip8_i)->trace, (chip8_i), (pc), (opcode)); } while (0)
+
+#endif
@@ -0,0 +1,34 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "triple.h"
+
+void CHIP8_triple_init(CHIP8_triple_t *triple) {
+  memset(triple->slots, 0, sizeof(triple->slots));
+  triple->back = 0;
+  atomic_init(&triple->middle, 1);
+  triple->front = 2;
+}
+
+// Slot the producer may write the next frame into
+CHIP8_frame_t* CHIP8_triple_back(CHIP8_triple_t *triple) {
+  return &triple->slots[triple->back];
+}
+
+// Hand the back slot to the consumer, replacing any frame it hasn't picked up yet
+void CHIP8_triple_publish(CHIP8_triple_t *triple) {
+  const uint32_t old = atomic_exchange_explicit(&triple->middle, triple->back | CHIP8_TRIPLE_FRESH, memory_order_acq_rel);
+  triple->back = old & ~CHIP8_TRIPLE_FRESH;
+}
+
+// Newest published frame, fresh is set if it wasn't returned by the previous call
+const CHIP8_frame_t* CHIP8_triple_front(CHIP8_triple_t *triple, bool *fresh) {
+  *fresh = atomic_load_explicit(&triple->middle, memory_order_relaxed) & CHIP8_TRIPLE_FRESH;
+  if (*fresh) {
+    const uint32_t old = atomic_exchange_explicit(&triple->middle, triple->front, memory_order_acq_rel);
+    triple->front = old & ~CHIP8_TRIPLE_FRESH;
+  }
+  return &triple->slots[triple->front];
+}
@@ -0,0 +1,34 @@
+#ifndef TRIPLE_H
+#define TRIPLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+// One published framebuffer
+typedef struct {
+  uint64_t display[CHIP8_PLANES][DISPLAY_MAX_HEIGHT][DISPLAY_WORDS];
+  bool hires;
+  uint64_t frame; // chip8_i->frames when it was published
+} CHIP8_frame_t;
+
+// Lock-free single producer/single consumer triple buffer.
+// The producer fills back and swaps it with middle, the consumer swaps middle with front when it
+// is marked fresh. Neither side ever waits and the consumer always gets the newest complete frame.
+typedef struct {
+  CHIP8_frame_t slots[3];
+  _Atomic uint32_t middle; // slot index, CHIP8_TRIPLE_FRESH set when the producer swapped it in
+  uint32_t back;           // producer's slot
+  uint32_t front;          // consumer's slot
+} CHIP8_triple_t;
+
+#define CHIP8_TRIPLE_FRESH 4u
+
+void CHIP8_triple_init(CHIP8_triple_t *triple);
+CHIP8_frame_t* CHIP8_triple_back(CHIP8_triple_t *triple);
+void CHIP8_triple_publish(CHIP8_triple_t *triple);
+const CHIP8_frame_t* CHIP8_triple_front(CHIP8_triple_t *triple, bool *fresh);
+
+#endif